@@ -0,0 +1,291 @@
+//
+//  bench_hash.c
+//  clox
+//
+//  Compares hashString against the FNV-1a hash it replaced, for speed on short identifiers and
+//  long strings, and for how well the hashes spread out. Not part of the clox build:
+//
+//    cc -O2 -Iinclude bench/bench_hash.c src/hash.c -o bench_hash && ./bench_hash
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+
+#include "hash.h"
+
+
+
+typedef uint32_t (*HashFn)(const char * key, int length);
+
+static uint32_t hashFnv1a(const char * key, int length)
+{
+	uint32_t hash = 2166136261u;
+
+	for (int i = 0; i < length; ++i)
+	{
+		hash = (hash ^ (uint8_t)key[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+static uint64_t s_rng = 0x853c49e6748fea9bull;
+
+static uint32_t randomU32(void)
+{
+	// xorshift64*
+
+	s_rng ^= s_rng >> 12;
+	s_rng ^= s_rng << 25;
+	s_rng ^= s_rng >> 27;
+	return (uint32_t)((s_rng * 0x2545f4914f6cdd1dull) >> 32);
+}
+
+static double secondsNow(void)
+{
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+// Keys are packed into one buffer with their offsets, so timing loops don't chase pointers
+
+typedef struct Keys
+{
+	char * aCh;
+	int * aiStart;		// cKey + 1 entries, key i is [aiStart[i], aiStart[i + 1])
+	int cKey;
+} Keys;
+
+static Keys makeKeys(int cKey, int cChMax, int (*fnWrite)(char * aCh, int iKey, int cChMax))
+{
+	Keys keys;
+	keys.aCh = malloc((size_t)cKey * cChMax);
+	keys.aiStart = malloc(sizeof(int) * (cKey + 1));
+	keys.cKey = cKey;
+
+	int iCh = 0;
+
+	for (int iKey = 0; iKey < cKey; ++iKey)
+	{
+		keys.aiStart[iKey] = iCh;
+		iCh += fnWrite(&keys.aCh[iCh], iKey, cChMax);
+	}
+
+	keys.aiStart[cKey] = iCh;
+
+	return keys;
+}
+
+static int writeIdentifier(char * aCh, int iKey, int cChMax)
+{
+	// Identifier-like: a short lowercase stem, sometimes a camelCase part, sometimes digits
+
+	static const char * s_aStem[] = { "x", "i", "key", "value", "count", "name", "node", "index", "result", "buffer" };
+	static const char * s_aPart[] = { "", "Max", "Prev", "Next", "List", "Total", "Count" };
+
+	UNUSED(iKey);
+	UNUSED(cChMax);
+
+	const char * stem = s_aStem[randomU32() % 10];
+	const char * part = s_aPart[randomU32() % 7];
+	unsigned suffix = randomU32() % 4 ? randomU32() % 1000 : 0;
+
+	return sprintf(aCh, (suffix) ? "%s%s%u" : "%s%s", stem, part, suffix);
+}
+
+static int writeSequential(char * aCh, int iKey, int cChMax)
+{
+	UNUSED(cChMax);
+	return sprintf(aCh, "key%d", iKey);
+}
+
+static int writeRandom(char * aCh, int iKey, int cChMax)
+{
+	UNUSED(iKey);
+
+	for (int iCh = 0; iCh < cChMax; ++iCh)
+	{
+		aCh[iCh] = (char)(' ' + randomU32() % 95);
+	}
+
+	return cChMax;
+}
+
+static void freeKeys(Keys * keys)
+{
+	free(keys->aCh);
+	free(keys->aiStart);
+}
+
+static double measureThroughput(HashFn fnHash, const Keys * keys, int cRepeat, double * pNsPerKey)
+{
+	// Returns GB/s, and the time per key through pNsPerKey
+
+	volatile uint32_t sink = 0;
+	double tStart = secondsNow();
+
+	for (int iRepeat = 0; iRepeat < cRepeat; ++iRepeat)
+	{
+		uint32_t acc = 0;
+
+		for (int iKey = 0; iKey < keys->cKey; ++iKey)
+		{
+			int iStart = keys->aiStart[iKey];
+			acc += fnHash(&keys->aCh[iStart], keys->aiStart[iKey + 1] - iStart);
+		}
+
+		sink += acc;
+	}
+
+	double dT = secondsNow() - tStart;
+	double cB = (double)keys->aiStart[keys->cKey] * cRepeat;
+
+	*pNsPerKey = dT * 1e9 / ((double)keys->cKey * cRepeat);
+	return cB / dT / 1e9;
+}
+
+static int compareU32(const void * a, const void * b)
+{
+	uint32_t nA = *(const uint32_t *)a;
+	uint32_t nB = *(const uint32_t *)b;
+	return (nA > nB) - (nA < nB);
+}
+
+static int countCollisions(HashFn fnHash, const Keys * keys)
+{
+	// Full 32-bit collisions. Random hashes would give about n^2 / 2^33.
+
+	uint32_t * aHash = malloc(sizeof(uint32_t) * keys->cKey);
+
+	for (int iKey = 0; iKey < keys->cKey; ++iKey)
+	{
+		int iStart = keys->aiStart[iKey];
+		aHash[iKey] = fnHash(&keys->aCh[iStart], keys->aiStart[iKey + 1] - iStart);
+	}
+
+	qsort(aHash, keys->cKey, sizeof(uint32_t), compareU32);
+
+	int cCollision = 0;
+	for (int iKey = 1; iKey < keys->cKey; ++iKey)
+	{
+		cCollision += (aHash[iKey] == aHash[iKey - 1]);
+	}
+
+	free(aHash);
+	return cCollision;
+}
+
+static double bucketChiSquare(HashFn fnHash, const Keys * keys, int cBitBucket)
+{
+	// Buckets picked the way Table does, from the bits above the 7 control bits. Chi-square
+	//  divided by the degrees of freedom, so about 1.0 is what uniform hashes give.
+
+	int cBucket = 1 << cBitBucket;
+	int * aCount = calloc(cBucket, sizeof(int));
+
+	for (int iKey = 0; iKey < keys->cKey; ++iKey)
+	{
+		int iStart = keys->aiStart[iKey];
+		uint32_t hash = fnHash(&keys->aCh[iStart], keys->aiStart[iKey + 1] - iStart);
+		aCount[(hash >> 7) & (cBucket - 1)]++;
+	}
+
+	double expected = (double)keys->cKey / cBucket;
+	double chi = 0.0;
+
+	for (int iBucket = 0; iBucket < cBucket; ++iBucket)
+	{
+		double d = aCount[iBucket] - expected;
+		chi += d * d / expected;
+	}
+
+	free(aCount);
+	return chi / (cBucket - 1);
+}
+
+static double worstAvalancheBias(HashFn fnHash, int cCh)
+{
+	// Flip each input bit of random keys and count how often each output bit changes. Ideal is
+	//  50% for every pair, returns the furthest any pair gets from that.
+
+	enum { cTrial = 2000 };
+	static int s_aaCount[64 * 8][32];
+	char aCh[64];
+
+	memset(s_aaCount, 0, sizeof(s_aaCount));
+
+	for (int iTrial = 0; iTrial < cTrial; ++iTrial)
+	{
+		writeRandom(aCh, 0, cCh);
+		uint32_t hash = fnHash(aCh, cCh);
+
+		for (int iBitIn = 0; iBitIn < cCh * 8; ++iBitIn)
+		{
+			aCh[iBitIn / 8] ^= (char)(1 << (iBitIn % 8));
+			uint32_t diff = hash ^ fnHash(aCh, cCh);
+			aCh[iBitIn / 8] ^= (char)(1 << (iBitIn % 8));
+
+			for (int iBitOut = 0; iBitOut < 32; ++iBitOut)
+			{
+				s_aaCount[iBitIn][iBitOut] += (diff >> iBitOut) & 1;
+			}
+		}
+	}
+
+	double biasMax = 0.0;
+
+	for (int iBitIn = 0; iBitIn < cCh * 8; ++iBitIn)
+	{
+		for (int iBitOut = 0; iBitOut < 32; ++iBitOut)
+		{
+			double bias = fabs((double)s_aaCount[iBitIn][iBitOut] / cTrial - 0.5);
+			biasMax = (bias > biasMax) ? bias : biasMax;
+		}
+	}
+
+	return biasMax;
+}
+
+int main(void)
+{
+	initHashSeed();
+
+	struct { const char * name; HashFn fnHash; } aHash[] =
+	{
+		{ "fnv1a", hashFnv1a },
+		{ "hashString", hashString },
+	};
+
+	Keys keysIdent = makeKeys(1000000, 32, writeIdentifier);
+	Keys keysSeq = makeKeys(1000000, 16, writeSequential);
+	Keys keysLong = makeKeys(64, 64 * 1024, writeRandom);
+
+	printf("%-12s %14s %14s %12s %12s %12s %12s\n",
+		"hash", "ident ns/key", "ident GB/s", "64KB GB/s", "collisions", "chi2/df", "avalanche");
+
+	for (size_t iHash = 0; iHash < sizeof(aHash) / sizeof(aHash[0]); ++iHash)
+	{
+		double nsIdent, nsLong;
+		double gbIdent = measureThroughput(aHash[iHash].fnHash, &keysIdent, 20, &nsIdent);
+		double gbLong = measureThroughput(aHash[iHash].fnHash, &keysLong, 50, &nsLong);
+		int cCollision = countCollisions(aHash[iHash].fnHash, &keysSeq);
+		double chi = bucketChiSquare(aHash[iHash].fnHash, &keysSeq, 16);
+		double bias8 = worstAvalancheBias(aHash[iHash].fnHash, 8);
+		double bias24 = worstAvalancheBias(aHash[iHash].fnHash, 24);
+
+		printf("%-12s %14.2f %14.2f %12.2f %12d %12.3f %11.1f%%\n",
+			aHash[iHash].name, nsIdent, gbIdent, gbLong, cCollision, chi,
+			100.0 * ((bias8 > bias24) ? bias8 : bias24));
+	}
+
+	printf("\ncollisions: 1M sequential keys (\"key0\"...), random hashes average about 116\n");
+	printf("chi2/df: the same keys over 65536 table buckets, uniform is about 1.0\n");
+	printf("avalanche: worst output bit bias after flipping one bit of an 8 or 24 byte key, ideal is 0%%,\n           sampling noise alone gives about 4%%\n");
+
+	freeKeys(&keysIdent);
+	freeKeys(&keysSeq);
+	freeKeys(&keysLong);
+
+	return 0;
+}
@@ -0,0 +1,248 @@
+//
+//  bench_number.c
+//  clox
+//
+//  Compares formatDouble against the modf + printf("%lld" / "%f") formatting it replaced, and
+//  against printf("%.17g") which round-trips but isn't shortest. Also checks that every
+//  formatted number reads back exactly, and times parseNumber against the strtod it replaced
+//  for literals. Not part of the clox build:
+//
+//    cc -O2 -Iinclude bench/bench_number.c src/number.c -o bench_number -lm && ./bench_number
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <limits.h>
+
+#include "number.h"
+
+
+
+typedef int (*FormatFn)(double num, char * aCh);
+
+static int formatPrintf(double num, char * aCh)
+{
+	double i;
+	double f = modf(num, &i);
+
+	if (f == 0.0 && i >= LLONG_MIN && i <= LLONG_MAX)
+	{
+		return snprintf(aCh, 320, "%lld", (long long)i);
+	}
+	else
+	{
+		return snprintf(aCh, 320, "%f", num);
+	}
+}
+
+static int formatPrintf17(double num, char * aCh)
+{
+	return snprintf(aCh, 320, "%.17g", num);
+}
+
+static int formatShortest(double num, char * aCh)
+{
+	return formatDouble(num, aCh);
+}
+
+static uint64_t s_rng = 0x853c49e6748fea9bull;
+
+static uint64_t randomU64(void)
+{
+	// xorshift64*
+
+	s_rng ^= s_rng >> 12;
+	s_rng ^= s_rng << 25;
+	s_rng ^= s_rng >> 27;
+	return s_rng * 0x2545f4914f6cdd1dull;
+}
+
+static double secondsNow(void)
+{
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static double randomBits(void)
+{
+	// Any finite double, so mostly huge or tiny magnitudes
+
+	for (;;)
+	{
+		uint64_t bits = randomU64();
+		double num;
+		memcpy(&num, &bits, sizeof(num));
+
+		if (isfinite(num))
+			return num;
+	}
+}
+
+static double randomDecimal(void)
+{
+	// Like a report column, e.g. 1234.56
+
+	return (double)(randomU64() % 10000000) / 100.0;
+}
+
+static double randomInteger(void)
+{
+	return (double)(int64_t)(randomU64() % 2000001) - 1000000.0;
+}
+
+static double * makeNumbers(int cNum, double (*fnRandom)(void))
+{
+	double * aNum = malloc(sizeof(double) * cNum);
+
+	for (int iNum = 0; iNum < cNum; ++iNum)
+	{
+		aNum[iNum] = fnRandom();
+	}
+
+	return aNum;
+}
+
+static double measureNsPerNumber(FormatFn fnFormat, const double * aNum, int cNum)
+{
+	char aCh[320];
+	volatile int sink = 0;
+	double tStart = secondsNow();
+
+	for (int iNum = 0; iNum < cNum; ++iNum)
+	{
+		sink += fnFormat(aNum[iNum], aCh);
+	}
+
+	return (secondsNow() - tStart) * 1e9 / cNum;
+}
+
+static int countRoundTripFailures(FormatFn fnFormat, const double * aNum, int cNum)
+{
+	char aCh[320];
+	int cFail = 0;
+
+	for (int iNum = 0; iNum < cNum; ++iNum)
+	{
+		int cCh = fnFormat(aNum[iNum], aCh);
+		aCh[cCh] = '\0';
+		cFail += (strtod(aCh, NULL) != aNum[iNum]);
+	}
+
+	return cFail;
+}
+
+static double averageLength(FormatFn fnFormat, const double * aNum, int cNum)
+{
+	char aCh[320];
+	double cChTotal = 0.0;
+
+	for (int iNum = 0; iNum < cNum; ++iNum)
+	{
+		cChTotal += fnFormat(aNum[iNum], aCh);
+	}
+
+	return cChTotal / cNum;
+}
+
+static void benchParse(const double * aNum, int cNum)
+{
+	// Literals as a script would have them, packed into one buffer with their offsets
+
+	char * aCh = malloc((size_t)cNum * 32);
+	int * aiStart = malloc(sizeof(int) * (cNum + 1));
+	int iCh = 0;
+
+	for (int iNum = 0; iNum < cNum; ++iNum)
+	{
+		aiStart[iNum] = iCh;
+		iCh += sprintf(&aCh[iCh], "%.*f", (int)(randomU64() % 7), aNum[iNum]) + 1;
+	}
+
+	aiStart[cNum] = iCh;
+
+	volatile double sink = 0.0;
+	int cMismatch = 0;
+
+	double tStart = secondsNow();
+
+	for (int iNum = 0; iNum < cNum; ++iNum)
+	{
+		sink += strtod(&aCh[aiStart[iNum]], NULL);
+	}
+
+	double nsStrtod = (secondsNow() - tStart) * 1e9 / cNum;
+	tStart = secondsNow();
+
+	for (int iNum = 0; iNum < cNum; ++iNum)
+	{
+		sink += parseNumber(&aCh[aiStart[iNum]], aiStart[iNum + 1] - aiStart[iNum] - 1);
+	}
+
+	double nsParse = (secondsNow() - tStart) * 1e9 / cNum;
+
+	for (int iNum = 0; iNum < cNum; ++iNum)
+	{
+		const char * pCh = &aCh[aiStart[iNum]];
+		cMismatch += (parseNumber(pCh, aiStart[iNum + 1] - aiStart[iNum] - 1) != strtod(pCh, NULL));
+	}
+
+	printf("\n%-14s %12s %12s\n", "parse", "decimal ns", "mismatches");
+	printf("%-14s %12.1f %12s\n", "strtod", nsStrtod, "-");
+	printf("%-14s %12.1f %12d\n", "parseNumber", nsParse, cMismatch);
+
+	free(aCh);
+	free(aiStart);
+}
+
+int main(void)
+{
+	enum { cNum = 1000000 };
+
+	struct { const char * name; FormatFn fnFormat; } aFormat[] =
+	{
+		{ "printf", formatPrintf },
+		{ "printf %.17g", formatPrintf17 },
+		{ "formatDouble", formatShortest },
+	};
+
+	double * aNumBits = makeNumbers(cNum, randomBits);
+	double * aNumDecimal = makeNumbers(cNum, randomDecimal);
+	double * aNumInteger = makeNumbers(cNum, randomInteger);
+
+	printf("%-14s %12s %12s %12s %12s %12s\n",
+		"format", "bits ns", "decimal ns", "integer ns", "decimal len", "roundtrip");
+
+	for (size_t iFormat = 0; iFormat < sizeof(aFormat) / sizeof(aFormat[0]); ++iFormat)
+	{
+		FormatFn fnFormat = aFormat[iFormat].fnFormat;
+
+		// "%f" prints the random bits as hundreds of digits, too slow and pointless to time
+
+		double nsBits = (fnFormat == formatPrintf) ? NAN : measureNsPerNumber(fnFormat, aNumBits, cNum);
+		double nsDecimal = measureNsPerNumber(fnFormat, aNumDecimal, cNum);
+		double nsInteger = measureNsPerNumber(fnFormat, aNumInteger, cNum);
+		double cChDecimal = averageLength(fnFormat, aNumDecimal, cNum);
+		int cFail = countRoundTripFailures(fnFormat, aNumDecimal, cNum);
+
+		if (fnFormat != formatPrintf)
+		{
+			cFail += countRoundTripFailures(fnFormat, aNumBits, cNum);
+		}
+
+		printf("%-14s %12.1f %12.1f %12.1f %12.2f %12d\n",
+			aFormat[iFormat].name, nsBits, nsDecimal, nsInteger, cChDecimal, cFail);
+	}
+
+	printf("\nbits: random finite doubles, decimal: cents up to 100000.00, integer: +-1000000\n");
+	printf("roundtrip: numbers that strtod doesn't read back exactly, out of 1M decimals (and 1M bits,\n           except for printf whose %%f can't hold them)\n");
+
+	benchParse(aNumDecimal, cNum);
+
+	free(aNumBits);
+	free(aNumDecimal);
+	free(aNumInteger);
+
+	return 0;
+}
@@ -0,0 +1,39 @@
+//
+//  arena.h
+//  clox
+//
+
+#pragma once
+
+#include "common.h"
+#include "array.h"
+
+
+
+// Bump allocator for short-lived data. Blocks come straight from the system allocator, so
+//  nothing allocated here counts toward vm.bytesAllocated or can trigger a collection.
+//  Individual allocations are never freed, everything goes at once in freeArena.
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct Arena
+{
+	ArenaBlock * block;		// Most recent block, older blocks are linked behind it
+	uint8_t * pBMic;		// Next free byte in block
+	uint8_t * pBMac;		// End of block
+	void * pLast;			// Most recent allocation, the only one that can grow in place
+} Arena; // tag = arena
+
+void initArena(Arena * arena);
+void freeArena(Arena * arena);
+void * allocArena(Arena * arena, size_t cb);
+void * reallocArena(Arena * arena, void * previous, size_t cbOld, size_t cbNew);
+
+// Stretchy buffers that grow in an arena. The buffer is read with the usual ARY_ macros,
+//  but must never be grown with ARY_PUSH or freed with ARY_FREE.
+
+#define ARENA_ARY_PUSH(_arena, _a, x) ((ARENA_ARY__ENSURECAP((_arena), (_a), ARY_LEN(_a) + 1)), (_a)[ARY__HDR(_a)->len++] = (x))
+
+#define ARENA_ARY__ENSURECAP(_arena, _a, n) (((n) <= ARY_CAP(_a)) ? 0 : ((_a) = Arena__AryGrow((_arena), (_a), (n), sizeof(*(_a)))))
+
+void * Arena__AryGrow(Arena * arena, void * ary, uint32_t newCapMin, uint32_t elemSize);
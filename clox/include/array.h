@@ -53,6 +53,9 @@ typedef struct AryHdr
 #define ARY_POP(_a) ((ARY_LEN(_a) > 0) ? ARY__HDR(_a)->len-- : 0)
 #define ARY_EMPTY(_a) (ARY_LEN(_a) == 0)
 #define ARY_CLEAR(_a) ((_a) ? ARY__HDR(_a)->len = 0 : 0)
+#define ARY_TRUNCATE(_a, _n) (ASSERT((uint32_t)(_n) <= ARY_LEN(_a)), (_a) ? ARY__HDR(_a)->len = (_n) : 0)
+#define ARY_CLONE(_a) Ary__Clone((_a), sizeof(*(_a))) // Copy with no spare capacity, NULL if empty
+#define ARY_APPEND(_a, _p, _n) ((_a) = Ary__Append((_a), (_p), (_n), sizeof(*(_a)))) // Push _n elements copied from _p
 
 // Helpers
 
@@ -94,6 +97,39 @@ static inline void * Ary__AllocGrow(void * ary, uint32_t newCapMin, uint32_t ele
 	return pHdr->aB;
 }
 
+static inline void * Ary__Clone(const void * ary, uint32_t elemSize)
+{
+	uint32_t len = ARY_LEN(ary);
+
+	if (len == 0)
+		return NULL;
+
+	AryHdr * pHdr = xmalloc(len * elemSize + offsetof(AryHdr, aB));
+	pHdr->len = len;
+	pHdr->cap = len;
+	memcpy(pHdr->aB, ary, len * elemSize);
+
+	return pHdr->aB;
+}
+
+static inline void * Ary__Append(void * ary, const void * p, uint32_t n, uint32_t elemSize)
+{
+	if (n == 0)
+		return ary;
+
+	uint32_t len = ARY_LEN(ary);
+
+	if (len + n > ARY_CAP(ary))
+	{
+		ary = Ary__AllocGrow(ary, len + n, elemSize);
+	}
+
+	memcpy((uint8_t *)ary + len * elemSize, p, n * elemSize);
+	ARY__HDR(ary)->len = len + n;
+
+	return ary;
+}
+
 static inline void Ary__Free(void * ary, uint32_t elemSize)
 {
 	if (ary)
@@ -10,6 +10,8 @@
 
 #include "value.h"
 
+typedef struct Arena Arena;
+
 
 
 typedef enum OpCode
@@ -68,6 +70,10 @@ typedef enum OpCode
 	OP_INHERIT,
 	OP_METHOD,
 	OP_METHOD_LONG,
+	OP_LIST,			// Pop N values into a new list
+	OP_LIST_APPEND,		// Pop N values and append them to the list below them
+	OP_INDEX_GET,
+	OP_INDEX_SET,
 
 	OP_MAX,
 	OP_MIN = 0,
@@ -90,14 +96,34 @@ typedef struct Chunk
 	Value * aryValConstants;
 
 	InstructionRange * aryInstrange;
+
+	// While compiling the arrays above grow in this arena, finishChunk moves them to the heap
+
+	Arena * arena;
 } Chunk; // tag = chunk
 
+// Hash index from constant Value to its position in a chunk's constant pool. Only lives
+//  while a chunk is being compiled, so that de-duplicating constants doesn't require a
+//  linear scan of the pool on every insert.
+
+typedef struct ConstantIndex
+{
+	int count;
+	int capacityMask;
+	uint32_t * aiConstant;	// 0 = empty slot, otherwise constant index + 1
+	Arena * arena;			// Where aiConstant is allocated, NULL for the heap
+} ConstantIndex; // tag = cidx
+
 
 
 void initChunk(Chunk * chunk);
 void freeChunk(Chunk * chunk);
+void finishChunk(Chunk * chunk);
 void writeChunk(Chunk * chunk, uint8_t byte, unsigned line);
-uint32_t addConstant(Chunk * chunk, Value value);
+uint32_t addConstant(Chunk * chunk, ConstantIndex * cidx, Value value);
 unsigned getLine(Chunk * chunk, unsigned instruction);
 
+void initConstantIndex(ConstantIndex * cidx, Arena * arena);
+void freeConstantIndex(ConstantIndex * cidx);
+
 void printInstructionRanges(Chunk * chunk);
@@ -21,6 +21,7 @@
 #define LIKELY(_f) (_f)
 #define UNLIKELY(_f) (_f)
 #define FUNCTION_PRETTY __FUNCSIG__
+#define THREAD_LOCAL __declspec(thread)
 #define TARGET_WINDOWS 1
 #define TARGET_MAC 0
 #else
@@ -28,6 +29,7 @@
 #define LIKELY(_f) __builtin_expect(!!(_f), 1)
 #define UNLIKELY(_f) __builtin_expect(!!(_f), 0)
 #define FUNCTION_PRETTY __PRETTY_FUNCTION__
+#define THREAD_LOCAL __thread
 #define TARGET_WINDOWS 0
 #define TARGET_MAC 1
 #endif
@@ -73,6 +75,31 @@
 #define DEBUG_ALLOC (DEBUG || _DEBUG)
 #endif
 
+// Compile function bodies the first time they are called instead of up front. Errors inside
+//  a function body are not reported until that function is first called.
+
+#ifndef COMPILER_LAZY_FUNCTIONS
+#define COMPILER_LAZY_FUNCTIONS 0
+#endif
+
+// Number of threads used to compile function bodies. 1 compiles serially, 0 uses one thread
+//  per processor. Ignored when COMPILER_LAZY_FUNCTIONS is set.
+
+#ifndef COMPILER_THREADS
+#define COMPILER_THREADS 1
+#endif
+
+// String hashes are seeded differently every run, so table layouts and the order maps iterate
+//  in change between runs too. Build with a fixed seed (-DHASH_SEED=1234) to get the same ones
+//  every time, e.g. to reproduce a failure.
+
+#ifndef HASH_SEED
+#define HASH_SEED 0
+#define HASH_SEED_RANDOM 1
+#else
+#define HASH_SEED_RANDOM 0
+#endif
+
 #define CASSERT(_f) static_assert(_f, #_f)
 #define CASSERTMSG(_f, _msg) static_assert(_f, _msg)
 #define UNUSED(_x) (void)(_x)
@@ -86,3 +113,4 @@
 #define UINT24_COUNT (UINT24_MAX + 1U)
 
 #define IS_POW2(_n) ((_n) && (((_n) & ((_n) - 1)) == 0))
+
@@ -12,6 +12,10 @@
 
 
 
+typedef struct LazyFunction LazyFunction;
+
 ObjFunction * compile(const char * source);
+bool compileLazyFunction(ObjFunction * function);
+void freeLazyFunction(LazyFunction * lazy);
 
 void markCompilerRoots(void);
@@ -12,5 +12,5 @@
 
 
 
-void disassembleChunk(Chunk * chunk, const char * name);
+void disassembleChunk(Chunk * chunk, const char * name, int nameLength); // name needn't be null terminated
 unsigned disassembleInstruction(Chunk * chunk, unsigned i);
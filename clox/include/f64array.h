@@ -0,0 +1,40 @@
+//
+//  f64array.h
+//  clox
+//
+
+#pragma once
+
+#include "common.h"
+
+
+
+// Use SSE2/AVX2 versions of the kernels when the processor supports them. Set to 0 to always
+//  use the scalar versions.
+
+#ifndef F64ARRAY_SIMD
+#define F64ARRAY_SIMD 1
+#endif
+
+// Bulk kernels over raw double arrays, used by the natives on ObjF64Array. Destinations may be
+//  the same array as a source. Sums, dot products and prefix sums add in a different order in
+//  each implementation, so their results can differ in the last bits between processors.
+
+typedef struct F64Kernels
+{
+	const char * name;
+	void (*add)(double * aDst, const double * aA, const double * aB, uint32_t c);	// aDst = aA + aB
+	void (*mul)(double * aDst, const double * aA, const double * aB, uint32_t c);	// aDst = aA * aB
+	void (*axpy)(double * aY, double alpha, const double * aX, uint32_t c);			// aY += alpha * aX
+	void (*scale)(double * aDst, const double * aA, double mul, double add, uint32_t c); // aDst = aA * mul + add
+	void (*fill)(double * aDst, double value, uint32_t c);
+	void (*prefixSum)(double * aDst, const double * aA, uint32_t c);				// Inclusive
+	double (*sum)(const double * aA, uint32_t c);
+	double (*dot)(const double * aA, const double * aB, uint32_t c);
+	double (*min)(const double * aA, uint32_t c);									// NaNs are skipped, +inf if none left
+	double (*max)(const double * aA, uint32_t c);									// NaNs are skipped, -inf if none left
+} F64Kernels; // tag = f64k
+
+// Best implementation for this processor, picked with CPUID the first time it's called
+
+const F64Kernels * getF64Kernels(void);
@@ -0,0 +1,16 @@
+//
+//  hash.h
+//  clox
+//
+
+#pragma once
+
+#include "common.h"
+
+
+
+// String hash, reading 8 bytes at a time (same construction as wyhash). Seeded once per
+//  process so scripts can't pick keys that all land in the same table slots.
+
+void initHashSeed(void); // Before anything is hashed, and before other threads start
+uint32_t hashString(const char * key, int length);
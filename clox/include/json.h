@@ -0,0 +1,30 @@
+//
+//  json.h
+//  clox
+//
+
+#pragma once
+
+#include "common.h"
+#include "value.h"
+
+
+
+// Deepest nesting of arrays and objects either direction handles. Also what stops
+//  writeJson on a list that contains itself.
+
+#ifndef JSON_DEPTH_MAX
+#define JSON_DEPTH_MAX 256
+#endif
+
+// Parses JSON text into maps (objects, keyed by interned strings), lists, strings, numbers,
+//  bools and nil, and pushes the result onto the VM stack. On failure pushes nothing and
+//  returns false with a message in aChErr. aCh must stay reachable by the GC.
+
+bool parseJson(const char * aCh, int cCh, char * aChErr, int cChErrMax);
+
+// Appends value to *paryCh as JSON, without whitespace. Map keys must be strings and are
+//  written in sorted order, and non-finite numbers are written as null. Returns NULL, or a message if value has something
+//  JSON can't hold.
+
+const char * writeJson(Value value, char ** paryCh);
@@ -0,0 +1,53 @@
+//
+//  memo.h
+//  clox
+//
+
+#pragma once
+
+#include "common.h"
+#include "value.h"
+
+
+
+// Results of a memoized function, keyed by its whole argument list. Arguments compare the way
+//  map keys do: numbers by value, strings by content, everything else by identity. Entries are
+//  chained off a power of two bucket array, and kept in least recently used order when the
+//  cache has a size cap.
+
+typedef struct MemoEntry
+{
+	uint32_t hash;
+	int32_t iChain;			// Next entry in the same bucket, -1 if last
+	int32_t iNewer;			// Least recently used order, -1 at either end
+	int32_t iOlder;
+	Value result;
+} MemoEntry; // tag = memoe
+
+typedef struct MemoCache
+{
+	int arity;
+	uint32_t cEntryMax;		// 0 if unbounded
+	uint32_t bucketMask;
+	int32_t * aiBucket;		// First entry in each bucket, -1 if empty
+	MemoEntry * aryEntry;
+	Value * aryArg;			// arity arguments per entry, in the same order as aryEntry
+	Value * aryArgPending;	// Arguments of calls that missed and haven't returned yet
+	int32_t iNewest;
+	int32_t iOldest;
+} MemoCache; // tag = memoc
+
+void initMemoCache(MemoCache * memoc, int arity, uint32_t cEntryMax);
+void freeMemoCache(MemoCache * memoc);
+void markMemoCache(MemoCache * memoc);
+
+uint32_t hashMemoArgs(const Value * aArg, int arity);
+
+// On a hit the entry becomes the most recently used
+
+bool memoCacheGet(MemoCache * memoc, const Value * aArg, uint32_t hash, Value * result);
+
+// May collect garbage, so aArg and result have to be reachable. Evicts the least recently used
+//  entry if the cache is full.
+
+void memoCacheSet(MemoCache * memoc, const Value * aArg, uint32_t hash, Value result);
@@ -0,0 +1,40 @@
+//
+//  number.h
+//  clox
+//
+
+#pragma once
+
+#include "common.h"
+
+
+
+// Longest thing formatDouble or formatInt64 writes, e.g. "-1.2345678901234567e-308"
+
+#define NUMBER_DIGITS_MAX 32
+
+// Shortest digits that read back as num. This is Grisu2, which always round-trips and is
+//  shortest for about 99.9% of doubles, the rest get a digit or two more than needed (1e23
+//  prints as 9.999999999999999e+22). Integers up to 21 digits are written out in full, other
+//  magnitudes switch to an exponent, e.g. "1e+21" and "1.5e-7". Returns the length, aCh is not
+//  null terminated.
+
+int formatDouble(double num, char aCh[NUMBER_DIGITS_MAX]);
+int formatInt64(int64_t i, char aCh[NUMBER_DIGITS_MAX]);
+
+// Reads a number literal the way the scanner finds them, digits with an optional fraction such
+//  as 12 or 0.25, correctly rounded. Also takes a leading '-' and an exponent, as in JSON's
+//  -1.5e-7. The text must already be well formed. Most numbers go through Eisel-Lemire, the
+//  rest (more than 19 significant digits that don't settle, or far from 1) fall back to strtod.
+
+double parseNumber(const char * pCh, int cCh);
+
+// Length of the number at the start of [pCh, pChEnd), 0 if there isn't one. Takes JSON's
+//  grammar, -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?, so no "nan", "inf", hex or
+//  whitespace. *pIsInteger is set when it's only digits, for parseInteger.
+
+int scanNumber(const char * pCh, const char * pChEnd, bool * pIsInteger);
+
+// Same for literals that are only digits, see Token.isInteger
+
+double parseInteger(const char * pCh, int cCh);
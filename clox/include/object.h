@@ -12,6 +12,9 @@
 #include "chunk.h"
 #include "value.h"
 #include "table.h"
+#include "hash.h"
+#include "source.h"
+#include "memo.h"
 
 
 
@@ -25,6 +28,12 @@ typedef enum ObjType
 	OBJ_CLOSURE,
 	OBJ_BOUND_METHOD,
 	OBJ_NATIVE,
+	OBJ_MAP,
+	OBJ_LIST,
+	OBJ_F64ARRAY,
+	OBJ_STRING_BUILDER,
+	OBJ_WEAK_REF,
+	OBJ_MEMO,
 } ObjType;
 
 typedef struct Obj
@@ -38,14 +47,57 @@ typedef struct Obj
 
 static_assert(sizeof(Obj) == 8, "");
 
+typedef enum StringKind
+{
+	STRING_INLINE,		// aChars points at characters allocated along with the string, see ObjStringInline
+	STRING_OWNED,		// aChars is a separate allocation owned by the string
+	STRING_SLICE,		// aChars points into another string, see ObjStringSlice
+	STRING_STATIC,		// aChars points into a script's source, see ObjStringStatic
+} StringKind;
+
 typedef struct ObjString
 {
 	Obj obj;
-	uint32_t hash;
+	uint32_t hash;			// Only valid once isHashed is set
 	int length;
-	const char * aChars;
+	const char * aChars;	// Null terminated, except for slices and static strings
+	uint8_t kind;			// StringKind
+	bool isInterned;		// Interned strings are equal only if they're the same object
+	bool isHashed;
 } ObjString;
 
+// Most strings keep their characters right after the header, so they take one allocation
+//  instead of two and comparing them doesn't touch another cache line.
+
+typedef struct ObjStringInline
+{
+	ObjString str;
+	char aChInline[];
+} ObjStringInline;
+
+static inline size_t sizeofStringInline(int length)
+{
+	return offsetof(ObjStringInline, aChInline) + length + 1;
+}
+
+// A substring that shares its parent's characters rather than copying them. Slices start out
+//  un-interned and unhashed, and are never interned themselves, see internString.
+
+typedef struct ObjStringSlice
+{
+	ObjString str;
+	ObjString * parent;		// Always the string that owns the characters, never another slice
+} ObjStringSlice;
+
+// A literal or identifier whose characters are left where the compiler found them. Freeing it
+//  only drops its reference on the source, and its characters never count as allocated.
+
+typedef struct ObjStringStatic
+{
+	ObjString str;
+	SourceBuffer * source;
+} ObjStringStatic;
+
 typedef struct ObjUpvalue
 {
 	Obj obj;
@@ -61,6 +113,7 @@ typedef struct ObjFunction
 	int upvalueCount;
 	Chunk chunk;
 	ObjString * name;
+	struct LazyFunction * lazy; // Non-null until the body is compiled (see COMPILER_LAZY_FUNCTIONS)
 } ObjFunction;
 
 typedef struct ObjClass
@@ -90,9 +143,54 @@ typedef struct ObjBoundMethod
 {
 	Obj obj;
 	Value receiver;
-	ObjClosure* method;
+	Obj * method;		// ObjClosure, or ObjNative for methods of built-in classes
 } ObjBoundMethod;
 
+// Weak maps don't keep object keys alive, and only keep a value alive while its key is. Entries
+//  are dropped when their key is collected. Keys that aren't objects, and strings since equal
+//  ones can always be made again, are still held strongly.
+
+typedef struct ObjMap
+{
+	Obj obj;
+	ValueTable table;
+	bool isWeak;
+} ObjMap;
+
+typedef struct ObjList
+{
+	Obj obj;
+	Value * aryValue;
+} ObjList;
+
+typedef struct ObjF64Array
+{
+	Obj obj;
+	uint32_t count;
+	double * aF64;		// Raw doubles rather than Values, so bulk kernels can run over them directly
+} ObjF64Array;
+
+typedef struct ObjStringBuilder
+{
+	Obj obj;
+	char * aryCh;		// Not null terminated, or hashed or interned until it's turned into a string
+} ObjStringBuilder;
+
+typedef struct ObjWeakRef
+{
+	Obj obj;
+	Obj * target;		// NULL once the target has been collected
+} ObjWeakRef;
+
+// Calls closure, unless it was already called with the same arguments. See memoize.
+
+typedef struct ObjMemo
+{
+	Obj obj;
+	ObjClosure * closure;
+	MemoCache cache;
+} ObjMemo;
+
 typedef bool (*NativeFn)(int argCount, Value * args);
 
 typedef struct ObjNative
@@ -145,12 +243,31 @@ extern ObjFunction * newFunction(void);
 extern ObjClass * newClass(ObjString * name);
 extern ObjInstance * newInstance(ObjClass * klass);
 extern ObjClosure * newClosure(ObjFunction * function);
-extern ObjBoundMethod * newBoundMethod(Value receiver, ObjClosure* method);
+extern ObjBoundMethod * newBoundMethod(Value receiver, Obj * method);
 extern ObjNative * newNative(NativeFn function);
+extern ObjMap * newMap(void);
+extern ObjMap * newWeakMap(void);
+extern ObjList * newList(void);
+extern ObjF64Array * newF64Array(uint32_t count); // Zero filled
+extern ObjStringBuilder * newStringBuilder(void);
+extern ObjWeakRef * newWeakRef(Obj * target);
+extern ObjMemo * newMemo(ObjClosure * closure, uint32_t cEntryMax); // 0 for no limit
+
+// Transient strings are neither hashed nor interned until something needs them to be, which
+//  most temporaries never do. See internString.
+
+extern ObjString * concatStrings(const ObjString * pStrA, const ObjString * pStrB); // Transient
+extern ObjString * copyStringTransient(const char * chars, int length);
 
-extern ObjString * concatStrings(const ObjString * pStrA, const ObjString * pStrB);
 extern ObjString * copyString(const char * chars, int length); // Copy into new memory
+extern ObjString * copyStringWithHash(const char * chars, int length, uint32_t hash); // Same, hash is from hashString()
 extern ObjString * takeString(const char * chars, int length); // Take ownership of chars memory
+extern ObjString * copyStringStatic(SourceBuffer * src, const char * chars, int length, uint32_t hash); // chars must be in src
+extern ObjString * sliceString(ObjString * str, int start, int length); // str must be reachable by the GC
+
+extern ObjString * internString(ObjString * str); // Interned string with the same characters, possibly str itself
+extern uint32_t getStringHash(ObjString * str);
+extern bool stringsEqual(const ObjString * strA, const ObjString * strB);
 
 extern void printObject(Value value);
 
@@ -169,6 +286,12 @@ static inline bool isObjType(Value value, ObjType type)
 #define IS_BOUND_METHOD(value)	isObjType(value, OBJ_BOUND_METHOD)
 #define IS_NATIVE(value)		isObjType(value, OBJ_NATIVE)
 #define IS_STRING(value)		isObjType(value, OBJ_STRING)
+#define IS_MAP(value)			isObjType(value, OBJ_MAP)
+#define IS_LIST(value)			isObjType(value, OBJ_LIST)
+#define IS_F64ARRAY(value)		isObjType(value, OBJ_F64ARRAY)
+#define IS_STRING_BUILDER(value)	isObjType(value, OBJ_STRING_BUILDER)
+#define IS_WEAK_REF(value)		isObjType(value, OBJ_WEAK_REF)
+#define IS_MEMO(value)			isObjType(value, OBJ_MEMO)
 
 #define AS_UPVALUE(value)		((ObjUpvalue*)AS_OBJ(value))
 #define AS_FUNCTION(value)		((ObjFunction*)AS_OBJ(value))
@@ -179,3 +302,9 @@ static inline bool isObjType(Value value, ObjType type)
 #define AS_NATIVE(value)		(((ObjNative*)AS_OBJ(value))->function)
 #define AS_STRING(value)		((ObjString*)AS_OBJ(value))
 #define AS_CSTRING(value)		(((ObjString*)AS_OBJ(value))->aChars)
+#define AS_MAP(value)			((ObjMap*)AS_OBJ(value))
+#define AS_LIST(value)			((ObjList*)AS_OBJ(value))
+#define AS_F64ARRAY(value)		((ObjF64Array*)AS_OBJ(value))
+#define AS_STRING_BUILDER(value)	((ObjStringBuilder*)AS_OBJ(value))
+#define AS_WEAK_REF(value)		((ObjWeakRef*)AS_OBJ(value))
+#define AS_MEMO(value)			((ObjMemo*)AS_OBJ(value))
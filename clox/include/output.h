@@ -0,0 +1,41 @@
+//
+//  output.h
+//  clox
+//
+
+#pragma once
+
+#include "common.h"
+
+
+
+// Size of the VM's stdout buffer, print only goes through stdio when it fills up
+
+#ifndef OUTPUT_BUFFER_SIZE
+#define OUTPUT_BUFFER_SIZE 8192
+#endif
+
+typedef enum OutputMode
+{
+	OUTPUT_FULL_BUFFERED,	// Flushed when full, and before errors, prompts and exit
+	OUTPUT_LINE_BUFFERED,	// Also flushed after every newline, for interactive use
+	OUTPUT_UNBUFFERED,		// Written to stdout right away, keeps print in order with debug output
+} OutputMode;
+
+typedef struct OutputBuffer
+{
+	OutputMode mode;
+	int cCh;
+	char aCh[OUTPUT_BUFFER_SIZE];
+} OutputBuffer; // tag = outb
+
+// These all write to vm.output
+
+void initOutput(OutputMode mode);
+void setOutputMode(OutputMode mode);
+bool isOutputTerminal(void); // Whether stdout is a terminal rather than a file or pipe
+void flushOutput(void);
+
+void writeOutput(const char * pCh, int cCh);
+void writeOutputString(const char * sz);
+void writeOutputFormat(const char * format, ...) PRINTF_LIKE(1, 2);
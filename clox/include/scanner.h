@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include "common.h"
 
 
 typedef enum TokenType
@@ -15,6 +16,7 @@ typedef enum TokenType
 	// Single-character tokens
 	TOKEN_LEFT_PAREN, TOKEN_RIGHT_PAREN,
 	TOKEN_LEFT_BRACE, TOKEN_RIGHT_BRACE,
+	TOKEN_LEFT_BRACKET, TOKEN_RIGHT_BRACKET,
 	TOKEN_COMMA, TOKEN_DOT, TOKEN_MINUS, TOKEN_PLUS,
 	TOKEN_SEMICOLON, TOKEN_SLASH, TOKEN_STAR,
 
@@ -45,6 +47,8 @@ typedef struct Token
 	const char * start;
 	int length;
 	int line;
+	uint32_t hash; // Only for identifiers, see hashString
+	bool isInteger; // Only for numbers, set when there's no fraction, see parseInteger
 } Token;
 
 typedef struct Scanner
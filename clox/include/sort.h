@@ -0,0 +1,20 @@
+//
+//  sort.h
+//  clox
+//
+
+#pragma once
+
+#include "common.h"
+#include "value.h"
+
+
+
+// Strict weak ordering, true if a sorts before b
+
+typedef bool (*ValueLessFn)(Value a, Value b);
+
+// Unstable in-place introsort: quicksort that falls back to heapsort if partitioning goes badly,
+//  with insertion sort for short ranges. O(n log n) worst case and no allocation.
+
+void sortValues(Value * aValue, uint32_t cValue, ValueLessFn lessFn);
@@ -0,0 +1,30 @@
+//
+//  source.h
+//  clox
+//
+
+#pragma once
+
+#include "common.h"
+
+
+
+// A reference counted copy of a script's source. Function stubs and literal strings point
+//  straight into it, so it lives until the last of them is freed. The count is atomic since
+//  compiler threads retain it while holding the shared lock.
+
+typedef struct SourceBuffer
+{
+	volatile int64_t cRef;
+	int length;
+	char aCh[];
+} SourceBuffer; // tag = src
+
+SourceBuffer * newSourceBuffer(const char * source);
+SourceBuffer * retainSourceBuffer(SourceBuffer * src);
+void releaseSourceBuffer(SourceBuffer * src); // src may be NULL
+
+static inline bool isInSourceBuffer(const SourceBuffer * src, const char * chars, int length)
+{
+	return chars >= src->aCh && chars + length <= src->aCh + src->length;
+}
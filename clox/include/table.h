@@ -13,21 +13,32 @@
 
 
 
-// BB (matthewp) Add support for tables of other key types
-
 typedef struct ObjString ObjString;
+typedef struct TableMigration TableMigration;
 
-typedef struct Entry
-{
-	ObjString * key;
-	Value value;
-} Entry;
+// Open addressing in the style of a Swiss table. Every slot has a control byte, which is
+//  either empty, deleted, or the low 7 bits of the key's hash. Probing compares a whole group
+//  of control bytes at once, and only looks at keys whose control byte matches. Keys and
+//  values are kept apart so a lookup doesn't drag values through the cache.
+//
+// The control bytes are followed by a copy of the first TABLE_GROUP_SIZE of them, so a group
+//  can be loaded starting at any slot without wrapping.
+
+#define TABLE_GROUP_SIZE 16
 
 typedef struct Table
 {
-	int count;
+	int count;				// Live keys
+	int cTombstone;
 	int capacityMask;
-	Entry * aEntries;
+	int8_t * aCtrl;			// capacity + TABLE_GROUP_SIZE control bytes
+	ObjString ** aKeys;
+	Value * aValues;
+
+	// Set while a large table is resizing incrementally, keys not moved yet are still in
+	//  the old storage
+
+	TableMigration * migration;
 } Table;
 
 void initTable(Table * table);
@@ -45,3 +56,39 @@ ObjString * tableFindString(Table * table, const char * aCh, int length, uint32_
 
 void markTable(Table* table);
 void tableRemoveWhite(Table* table);
+
+
+
+// Same layout, but keyed by any Value. Keys compare with valuesSame, so 0 and -0 are one key
+//  and so is NaN. Doesn't resize incrementally, it's only used for script maps.
+
+typedef struct ValueTable
+{
+	int count;				// Live keys
+	int cTombstone;
+	int capacityMask;
+	int8_t * aCtrl;			// capacity + TABLE_GROUP_SIZE control bytes
+	Value * aKeys;
+	Value * aValues;
+} ValueTable; // tag = vtable
+
+void initValueTable(ValueTable * vtable);
+void freeValueTable(ValueTable * vtable);
+
+bool valueTableSet(ValueTable * vtable, Value key, Value value);
+bool valueTableGet(ValueTable * vtable, Value key, Value * value);
+bool valueTableDelete(ValueTable * vtable, Value key);
+
+// First used slot at or after iSlot, -1 if none. Deleting keys doesn't move the others, but
+//  inserting may.
+
+int valueTableNext(ValueTable * vtable, int iSlot);
+
+void markValueTable(ValueTable * vtable);
+
+// For weak maps. Marks the values of keys that are already marked, and keys that aren't held
+//  weakly, returning whether anything new was marked. Once nothing is, removes the entries
+//  whose keys are still unmarked.
+
+bool markValueTableEphemerons(ValueTable * vtable);
+void valueTableRemoveWhite(ValueTable * vtable);
@@ -0,0 +1,49 @@
+//
+//  thread.h
+//  clox
+//
+
+#pragma once
+
+#include "common.h"
+
+#if TARGET_WINDOWS
+#include <intrin.h>
+#endif
+
+
+
+// Minimal platform threading layer. Handles are allocated with the system allocator rather
+//  than xrealloc, they aren't part of the GC heap.
+
+typedef struct Thread Thread;
+typedef struct Mutex Mutex;
+typedef struct CondVar CondVar;
+
+typedef void (*ThreadFn)(void * arg);
+
+Thread * startThread(ThreadFn function, void * arg);
+void joinThread(Thread * thread);
+
+Mutex * newMutex(void);
+void freeMutex(Mutex * mutex);
+void lockMutex(Mutex * mutex);
+void unlockMutex(Mutex * mutex);
+
+CondVar * newCondVar(void);
+void freeCondVar(CondVar * condvar);
+void waitCondVar(CondVar * condvar, Mutex * mutex);
+void broadcastCondVar(CondVar * condvar);
+
+int getProcessorCount(void);
+
+static inline int64_t atomicAdd64(volatile int64_t * p, int64_t n)
+{
+	// Returns the previous value
+
+#if TARGET_WINDOWS
+	return _InterlockedExchangeAdd64((volatile __int64 *)p, n);
+#else
+	return __atomic_fetch_add(p, n, __ATOMIC_RELAXED);
+#endif
+}
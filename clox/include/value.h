@@ -24,6 +24,14 @@ typedef enum ValueType
 #	define VALUES_USE_NAN_BOXING 1
 #endif // VALUES_USE_NAN_BOXING
 
+// Numbers that are 32-bit integers get their own NaN-boxed tag, so integer arithmetic and
+//  comparisons can skip the FPU. They're still just numbers to scripts: every operation gives
+//  the same result it would with doubles, and falls back to doubles on overflow.
+
+#ifndef VALUES_USE_INT_TAG
+#	define VALUES_USE_INT_TAG VALUES_USE_NAN_BOXING
+#endif // VALUES_USE_INT_TAG
+
 #if VALUES_USE_NAN_BOXING
 
 typedef uint64_t Value;
@@ -46,6 +54,9 @@ CASSERT(sizeof(Value) == sizeof(uint64_t));
 
 #define _VAL_PTR_MASK		(_VAL_QNAN | _VAL_SIGN_BIT)
 
+#define _VAL_INT_TAG		0x7ffd000000000000ull // Quiet NaN plus the lowest spare bit, payload in the low 32 bits
+#define _VAL_INT_MASK		0xffff000000000000ull
+
 inline static double _ValueCastToNum(Value value)
 {
 	DoubleUnion u;
@@ -69,15 +80,51 @@ inline static Value _NumCastToValue(double num)
 #define NUMBER_VAL(value)	_NumCastToValue(value)
 #define OBJ_VAL(object)		(Value)(_VAL_SIGN_BIT | _VAL_QNAN | (uint64_t)(uintptr_t)(object))
 
-#define IS_BOOL(value)		(((value) & FALSE_VAL) == FALSE_VAL)
+#define IS_BOOL(value)		(((value) | 1) == TRUE_VAL)
 #define IS_NIL(value)		((value) == NIL_VAL)
-#define IS_NUMBER(value)	(((value) & _VAL_QNAN) != _VAL_QNAN)
+#define IS_DOUBLE(value)	(((value) & _VAL_QNAN) != _VAL_QNAN)
+#define IS_NUMBER(value)	(IS_DOUBLE(value) || IS_INT(value))
 #define IS_OBJ(value)		(((value) & _VAL_PTR_MASK) == _VAL_PTR_MASK)
 
 #define AS_BOOL(value)		((value) == TRUE_VAL)
-#define AS_NUMBER(value)	_ValueCastToNum(value)
+#define AS_NUMBER(value)	_ValueAsNum(value)
 #define AS_OBJ(value)		((Obj*)(uintptr_t)((value) & ~_VAL_PTR_MASK))
 
+#if VALUES_USE_INT_TAG
+#define INT_VAL(value)		(Value)(_VAL_INT_TAG | (uint32_t)(int32_t)(value))
+#define IS_INT(value)		(((value) & _VAL_INT_MASK) == _VAL_INT_TAG)
+#define AS_INT(value)		((int32_t)(uint32_t)(value))
+#else // !VALUES_USE_INT_TAG
+#define INT_VAL(value)		NUMBER_VAL((double)(int32_t)(value))
+#define IS_INT(value)		false
+#define AS_INT(value)		((int32_t)AS_NUMBER(value))
+#endif // !VALUES_USE_INT_TAG
+
+inline static double _ValueAsNum(Value value)
+{
+	return IS_INT(value) ? (double)AS_INT(value) : _ValueCastToNum(value);
+}
+
+inline static Value _NumNarrowToValue(double num)
+{
+	// -0.0 has to stay a double, it prints and divides differently than 0
+
+	if (num >= INT32_MIN && num <= INT32_MAX)
+	{
+		int32_t n = (int32_t)num;
+
+		if ((double)n == num && (n != 0 || _NumCastToValue(num) == 0))
+			return INT_VAL(n);
+	}
+
+	return NUMBER_VAL(num);
+}
+
+inline static Value _Int64ToValue(int64_t n)
+{
+	return (n >= INT32_MIN && n <= INT32_MAX) ? INT_VAL(n) : NUMBER_VAL((double)n);
+}
+
 inline static ValueType _ValueType(Value value)
 {
 	if (IS_NUMBER(value))
@@ -131,7 +178,30 @@ CASSERT(sizeof(Value) == 2 * sizeof(void *));
 #define NUMBER_VAL(value)	((Value){ VAL_NUMBER, { .number = value } })
 #define OBJ_VAL(object)		((Value){ VAL_OBJ, { .obj = &object->obj } })
 
+#define IS_DOUBLE(value)	IS_NUMBER(value)
+#define INT_VAL(value)		NUMBER_VAL((double)(int32_t)(value))
+#define IS_INT(value)		false
+#define AS_INT(value)		((int32_t)AS_NUMBER(value))
+
+#define _NumNarrowToValue(num)	NUMBER_VAL(num)
+#define _Int64ToValue(n)		NUMBER_VAL((double)(n))
+
 #endif // !VALUES_USE_NAN_BOXING
 
+// Same number as NUMBER_VAL, tagged as an int when it is one. NUMBER_VAL itself never checks,
+//  so only use these where integers are likely.
+
+#define NUMBER_VAL_NARROW(value)	_NumNarrowToValue(value)
+#define INT64_VAL(value)			_Int64ToValue(value)
+
 bool valuesEqual(Value a, Value b);
+bool valuesSame(Value a, Value b); // Same as valuesEqual, except NaN is the same as itself
+uint32_t hashValue(Value value); // Consistent with both valuesEqual and valuesSame
 void printValue(Value value);
+
+// Writes num the way print shows it, the shortest digits that read back as num (see
+//  formatDouble). Returns the length, aCh is not null terminated and must hold
+//  NUMBER_FORMAT_MAX characters.
+
+#define NUMBER_FORMAT_MAX 32
+int formatNumber(double num, char * aCh, int cChMax);
@@ -13,6 +13,7 @@
 #include "value.h"
 #include "table.h"
 #include "object.h"
+#include "output.h"
 
 
 
@@ -31,6 +32,8 @@ typedef struct CallFrame
 	ObjClosure * closure;
 	uint8_t * ip;
 	Value * slots;
+	ObjMemo * memo;			// Set when a memoized call missed, the result is cached on return
+	uint32_t iArgPending;	// Where this call's arguments start in memo's pending arguments
 } CallFrame;
 
 typedef struct VM
@@ -42,6 +45,7 @@ typedef struct VM
 	Table globals;
 	Table strings;
 	ObjString * initString;
+	ObjClass * stringClass;		// Methods for string receivers, see defineNativeClass
 	ObjUpvalue * openUpvalues;
 
 	Obj * objects;
@@ -58,10 +62,18 @@ typedef struct VM
 
 	Obj ** grayStack;
 
+	// Weak maps and refs reached by the current collection, cleared once marking is done
+
+	ObjMap ** aryWeakMap;
+	ObjWeakRef ** aryWeakRef;
+
+	OutputBuffer output;	// What print writes, see flushOutput
+
 	size_t bytesAllocated;
 	size_t bytesAllocatedMax;
 	size_t nextGC;
 	bool runningGC;
+	bool multithreaded; // Set while other threads may allocate, collection is deferred until cleared
 } VM;
 
 extern VM vm;
@@ -0,0 +1,126 @@
+//
+//  arena.c
+//  clox
+//
+
+#include "arena.h"
+
+#include <stdlib.h>
+
+#define ARENA_BLOCK_SIZE (16 * 1024)
+#define ARENA_ALIGN 16
+
+
+
+struct ArenaBlock
+{
+	ArenaBlock * next;
+	uint8_t aB[];
+};
+
+static inline size_t alignSize(size_t cb)
+{
+	return (cb + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+void initArena(Arena * arena)
+{
+	arena->block = NULL;
+	arena->pBMic = NULL;
+	arena->pBMac = NULL;
+	arena->pLast = NULL;
+}
+
+void freeArena(Arena * arena)
+{
+	ArenaBlock * block = arena->block;
+
+	while (block != NULL)
+	{
+		ArenaBlock * next = block->next;
+		free(block);
+		block = next;
+	}
+
+	initArena(arena);
+}
+
+void * allocArena(Arena * arena, size_t cb)
+{
+	cb = alignSize(cb);
+
+	if (cb > (size_t)(arena->pBMac - arena->pBMic))
+	{
+		// Whatever is left in the current block is abandoned
+
+		size_t cbBlock = MAX(cb, ARENA_BLOCK_SIZE);
+		ArenaBlock * block = malloc(alignSize(sizeof(ArenaBlock)) + cbBlock);
+		ASSERTMSG(block != NULL, "Out of memory!");
+
+		block->next = arena->block;
+		arena->block = block;
+		arena->pBMic = (uint8_t *)block + alignSize(sizeof(ArenaBlock));
+		arena->pBMac = arena->pBMic + cbBlock;
+	}
+
+	void * p = arena->pBMic;
+	arena->pBMic += cb;
+	arena->pLast = p;
+
+	return p;
+}
+
+void * reallocArena(Arena * arena, void * previous, size_t cbOld, size_t cbNew)
+{
+	if (previous == NULL)
+		return allocArena(arena, cbNew);
+
+	if (cbNew <= cbOld)
+		return previous;
+
+	// The last allocation can grow in place if its block has room
+
+	if (previous == arena->pLast &&
+		alignSize(cbNew) <= (size_t)(arena->pBMac - (uint8_t *)previous))
+	{
+		arena->pBMic = (uint8_t *)previous + alignSize(cbNew);
+		return previous;
+	}
+
+	void * p = allocArena(arena, cbNew);
+	memcpy(p, previous, cbOld);
+
+	return p;
+}
+
+void * Arena__AryGrow(Arena * arena, void * ary, uint32_t newCapMin, uint32_t elemSize)
+{
+	uint32_t curCap = ARY_CAP(ary);
+	uint32_t newCap = curCap;
+
+	do
+	{
+		newCap = CARY_GROW_CAPACITY(newCap);
+	}
+	while (newCap < newCapMin);
+
+	ASSERTMSG(newCap <= (SIZE_MAX - offsetof(AryHdr, aB)) / elemSize, "Array allocation size overflow");
+
+	size_t sizeAlloc = newCap * elemSize + offsetof(AryHdr, aB);
+	AryHdr * pHdr;
+
+	if (ary)
+	{
+		size_t sizeAllocOld = curCap * elemSize + offsetof(AryHdr, aB);
+		pHdr = reallocArena(arena, ARY__HDR(ary), sizeAllocOld, sizeAlloc);
+	}
+	else
+	{
+		pHdr = allocArena(arena, sizeAlloc);
+		pHdr->len = 0;
+	}
+
+	pHdr->cap = newCap;
+
+	return pHdr->aB;
+}
@@ -12,13 +12,23 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#include "arena.h"
 #include "array.h"
 #include "vm.h"
 
+// Max load of 0.5, keeps probe sequences short since lookups happen on every constant emitted
+#define CONSTANT_INDEX_LOAD_THRESHOLD(_cap) ((_cap) >> 1)
+#define CONSTANT_INDEX_GROW_CAPACITY(_cap) ((_cap) < 16 ? 16 : (_cap) * 2)
 
+#define CHUNK_ARY_PUSH(_chunk, _a, x) \
+	((_chunk)->arena ? ARENA_ARY_PUSH((_chunk)->arena, _a, x) : ARY_PUSH(_a, x))
 
-static void addInstructionToRange(InstructionRange ** paryInstrange, unsigned instruction, unsigned line)
+
+
+static void addInstructionToRange(Chunk * chunk, unsigned instruction, unsigned line)
 {
+	InstructionRange ** paryInstrange = &chunk->aryInstrange;
+
 	// We assume line numbers are always non-decreasing as we add instructions
 
 	ASSERT(ARY_EMPTY(*paryInstrange) || line >= ARY_TAIL(*paryInstrange)->line);
@@ -31,7 +41,7 @@ static void addInstructionToRange(InstructionRange ** paryInstrange, unsigned in
 
 		InstructionRange instrange = { instruction, instruction + 1, line };
 
-		ARY_PUSH(*paryInstrange, instrange);
+		CHUNK_ARY_PUSH(chunk, *paryInstrange, instrange);
 	}
 	else
 	{
@@ -75,34 +85,152 @@ void initChunk(Chunk * chunk)
 
 void freeChunk(Chunk * chunk)
 {
+	ASSERTMSG(chunk->arena == NULL, "Chunk is still being compiled");
+
 	ARY_FREE(chunk->aryB);
 	ARY_FREE(chunk->aryValConstants);
 	ARY_FREE(chunk->aryInstrange);
 	initChunk(chunk);
 }
 
+void finishChunk(Chunk * chunk)
+{
+	if (chunk->arena == NULL)
+		return;
+
+	// Copy each array out of the arena into a buffer of exactly its length. The chunk stays
+	//  reachable while we allocate, so a collection part way through still sees valid arrays.
+
+	chunk->aryB = ARY_CLONE(chunk->aryB);
+	chunk->aryValConstants = ARY_CLONE(chunk->aryValConstants);
+	chunk->aryInstrange = ARY_CLONE(chunk->aryInstrange);
+	chunk->arena = NULL;
+}
+
 void writeChunk(Chunk * chunk, uint8_t byte, unsigned line)
 {
-	ARY_PUSH(chunk->aryB, byte);
+	CHUNK_ARY_PUSH(chunk, chunk->aryB, byte);
+
+	addInstructionToRange(chunk, ARY_LEN(chunk->aryB) - 1, line);
+}
+
+static uint32_t * findConstantSlot(ConstantIndex * cidx, Chunk * chunk, Value value, uint32_t hash)
+{
+	uint32_t index = hash & cidx->capacityMask;
+
+	for (;;)
+	{
+		uint32_t * slot = &cidx->aiConstant[index];
+
+		if (*slot == 0 || valuesEqual(chunk->aryValConstants[*slot - 1], value))
+			return slot;
+
+		index = (index + 1) & cidx->capacityMask;
+	}
+
+	// Unreachable
+}
+
+static void adjustConstantIndexCapacity(ConstantIndex * cidx, Chunk * chunk, int capacityMask)
+{
+	ASSERT(IS_POW2(capacityMask + 1));
+
+	if (cidx->arena != NULL)
+	{
+		cidx->aiConstant = allocArena(cidx->arena, sizeof(uint32_t) * (capacityMask + 1));
+	}
+	else
+	{
+		CARY_FREE(uint32_t, cidx->aiConstant, cidx->capacityMask + 1);
+		cidx->aiConstant = CARY_ALLOCATE(uint32_t, capacityMask + 1);
+	}
+
+	cidx->capacityMask = capacityMask;
+
+	memset(cidx->aiConstant, 0, sizeof(uint32_t) * (capacityMask + 1));
 
-	addInstructionToRange(&chunk->aryInstrange, ARY_LEN(chunk->aryB) - 1, line);
+	// Every constant in the pool is already unique, so just drop each one into the first empty slot
+
+	for (int iVal = 0; iVal < cidx->count; ++iVal)
+	{
+		uint32_t index = hashValue(chunk->aryValConstants[iVal]) & capacityMask;
+
+		while (cidx->aiConstant[index] != 0)
+		{
+			index = (index + 1) & capacityMask;
+		}
+
+		cidx->aiConstant[index] = iVal + 1;
+	}
 }
 
-uint32_t addConstant(Chunk * chunk, Value value)
+uint32_t addConstant(Chunk * chunk, ConstantIndex * cidx, Value value)
 {
 	uint32_t cVal = ARY_LEN(chunk->aryValConstants);
 
-	for (uint32_t iVal = 0; iVal < cVal; ++iVal)
+	if (cidx == NULL)
 	{
-		if (valuesEqual(chunk->aryValConstants[iVal], value))
-			return iVal;
+		for (uint32_t iVal = 0; iVal < cVal; ++iVal)
+		{
+			if (valuesEqual(chunk->aryValConstants[iVal], value))
+				return iVal;
+		}
+
+		push(value);
+		CHUNK_ARY_PUSH(chunk, chunk->aryValConstants, value);
+		pop();
+
+		return cVal;
 	}
 
+	// The index must have seen every constant in this chunk
+
+	ASSERT((uint32_t)cidx->count == cVal);
+
+	// Keep the value reachable, growing the index or the pool may trigger a collection
+
 	push(value);
-	ARY_PUSH(chunk->aryValConstants, value);
+
+	int capacity = cidx->capacityMask + 1;
+
+	if (cidx->count + 1 > CONSTANT_INDEX_LOAD_THRESHOLD(capacity))
+	{
+		adjustConstantIndexCapacity(cidx, chunk, CONSTANT_INDEX_GROW_CAPACITY(capacity) - 1);
+	}
+
+	uint32_t * slot = findConstantSlot(cidx, chunk, value, hashValue(value));
+
+	if (*slot == 0)
+	{
+		CHUNK_ARY_PUSH(chunk, chunk->aryValConstants, value);
+
+		*slot = cVal + 1;
+		cidx->count++;
+	}
+
 	pop();
 
-	return cVal;
+	return *slot - 1;
+}
+
+void initConstantIndex(ConstantIndex * cidx, Arena * arena)
+{
+	cidx->count = 0;
+	cidx->capacityMask = -1;
+	cidx->aiConstant = NULL;
+	cidx->arena = arena;
+}
+
+void freeConstantIndex(ConstantIndex * cidx)
+{
+	ASSERT(cidx->capacityMask == -1 || IS_POW2(cidx->capacityMask + 1));
+
+	if (cidx->arena == NULL)
+	{
+		CARY_FREE(uint32_t, cidx->aiConstant, cidx->capacityMask + 1);
+	}
+
+	initConstantIndex(cidx, cidx->arena);
 }
 
 unsigned getLine(Chunk * chunk, unsigned instruction)
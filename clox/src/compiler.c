@@ -8,21 +8,53 @@
 
 #include "common.h"
 #include "compiler.h"
+#include "arena.h"
 #include "scanner.h"
 #include "debug.h"
 #include "object.h"
 #include "array.h"
+#include "thread.h"
+#include "source.h"
+#include "number.h"
+#include "vm.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 
 
 
+typedef struct IdentifierEntry
+{
+	ObjString * str;		// NULL if empty
+	uint32_t constant;		// Index of str in the constants of the compiler with id idCompiler
+	uint32_t idCompiler;
+} IdentifierEntry; // tag = ident
+
+typedef struct IdentifierCache
+{
+	int count;
+	int capacityMask;
+	IdentifierEntry * aIdent;
+} IdentifierCache; // tag = identc
+
 typedef struct Parser
 {
 	Token current;
 	Token previous;
 
+	SourceBuffer * source; // Shared with any function stubs and literal strings
+
+	// Everything that only lives as long as this compile: locals, upvalues, chunks until
+	//  they are finished, and the lookup tables below. Keeping it out of the GC heap means
+	//  growing it never triggers a collection.
+
+	Arena arena;
+
+	// Identifiers seen so far by this compile, so each name is only interned once
+
+	IdentifierCache identifiers;
+	uint32_t cCompiler;
+
 	bool hadError;
 	bool panicMode;
 } Parser;
@@ -38,7 +70,7 @@ typedef enum Precedence
 	PREC_TERM,			// + -
 	PREC_FACTOR,		// * /
 	PREC_UNARY,			// ! -
-	PREC_CALL,			// . ()
+	PREC_CALL,			// . () []
 	PREC_PRIMARY,
 } Precedence;
 
@@ -86,6 +118,14 @@ typedef struct Compiler
 	Local * locals;
 	Upvalue * upvalues;
 	int scopeDepth;
+
+	ConstantIndex constantIndex;
+	uint32_t id; // Unique per parser, for IdentifierEntry::idCompiler
+
+	// Set when compiling the body of a lazy function stub, which has no enclosing
+	//  compiler to resolve upvalues against
+
+	LazyFunction * lazy;
 } Compiler;
 
 typedef struct ClassCompiler
@@ -95,8 +135,44 @@ typedef struct ClassCompiler
 	bool hasSuperclass;
 } ClassCompiler;
 
-Compiler * current = NULL;
-ClassCompiler * currentClass = NULL;
+struct LazyFunction
+{
+	SourceBuffer * source;
+	const char * start;		// Start of the parameter list
+	int line;
+	FunctionType type;
+	bool inClass;
+	bool hasSuperclass;
+	Token * aryUpvalueName;	// Captured variable names, in upvalue order
+};
+
+// Names declared inside a function body while skimming it, see skimBlock
+
+typedef struct Skimmer
+{
+	Token * aryName;
+	uint32_t * aryScopeStart;
+} Skimmer;
+
+// Shared state for compiling function bodies on worker threads (see COMPILER_THREADS)
+
+typedef struct CompileQueue
+{
+	ObjFunction ** aryFunction;	// Stubs waiting for their body to be compiled
+	int cBusy;
+	bool hadError;
+
+	Mutex * mutex;
+	CondVar * condvar;
+} CompileQueue;
+
+THREAD_LOCAL Compiler * current = NULL;
+THREAD_LOCAL ClassCompiler * currentClass = NULL;
+
+static CompileQueue s_queue;
+
+#define SKIM_FUNCTIONS (COMPILER_LAZY_FUNCTIONS || COMPILER_THREADS != 1)
+#define PARALLEL_FUNCTIONS (!COMPILER_LAZY_FUNCTIONS && COMPILER_THREADS != 1)
 
 
 static void advance(void);
@@ -109,9 +185,8 @@ static void consume(TokenType type, const char * message);
 static void emitByte(uint8_t byte);
 static void emitBytes(uint8_t byte1, uint8_t byte2);
 static Chunk * currentChunk(void);
-static void initCompiler(Compiler * compiler, Scanner * scanner, Parser * parser, FunctionType type);
+static void initCompiler(Compiler * compiler, Scanner * scanner, Parser * parser, FunctionType type, ObjFunction * function);
 static ObjFunction * endCompiler(void);
-static void destroyCompiler(Compiler * compiler);
 static void emitReturn(void);
 static void expression(void);
 static void statement(void);
@@ -125,24 +200,38 @@ static void whileStatement(void);
 static void expressionStatement(void);
 static void forStatement(void);
 static void ifStatement(void);
+static void block(void);
+static void functionParameters(void);
 static void parsePrecedence(Precedence precendece);
 static uint32_t identifierConstant(Token * name);
+static ObjString * sourceString(const char * chars, int length, uint32_t hash);
 static bool resolveLocal(Compiler * compiler, Token * name, uint32_t * localIndex);
 static bool resolveUpvalue(Compiler * compiler, Token * name, uint32_t * upvalueIndex);
 static void declareVariable(void);
 static uint8_t argumentList(void);
 static const ParseRule * getRule(TokenType type);
+static Token syntheticToken(const char * text);
+static void initIdentifierCache(IdentifierCache * identc);
+static bool compileQueuedFunctions(void);
 
 ObjFunction * compile(const char * source)
 {
-	Scanner scanner;
-	initScanner(&scanner, source);
-
 	Parser parser;
 	memset(&parser, 0, sizeof(parser));
+	initArena(&parser.arena);
+	initIdentifierCache(&parser.identifiers);
+
+	// Function stubs and literal strings keep pointing into the source, so they need a copy
+	//  that outlives the caller's buffer
+
+	parser.source = newSourceBuffer(source);
+	source = parser.source->aCh;
+
+	Scanner scanner;
+	initScanner(&scanner, source);
 
 	Compiler compiler;
-	initCompiler(&compiler, &scanner, &parser, TYPE_SCRIPT);
+	initCompiler(&compiler, &scanner, &parser, TYPE_SCRIPT, NULL);
 
 	advance();
 
@@ -152,11 +241,203 @@ ObjFunction * compile(const char * source)
 	}
 
 	ObjFunction * function = endCompiler();
-	destroyCompiler(&compiler);
+
+	if (PARALLEL_FUNCTIONS)
+	{
+		// Top-level code is done, every function it declared is waiting in the queue
+
+		if (!parser.hadError && !compileQueuedFunctions())
+		{
+			parser.hadError = true;
+		}
+
+		ARY_FREE(s_queue.aryFunction);
+	}
+
+	freeArena(&parser.arena);
+	releaseSourceBuffer(parser.source);
 
 	return parser.hadError ? NULL : function;
 }
 
+bool compileLazyFunction(ObjFunction * function)
+{
+	LazyFunction * lazy = function->lazy;
+
+	ASSERT(lazy != NULL);
+	ASSERT(current == NULL);
+
+	Scanner scanner;
+	initScanner(&scanner, lazy->start);
+	scanner.line = lazy->line;
+
+	Parser parser;
+	memset(&parser, 0, sizeof(parser));
+	initArena(&parser.arena);
+	initIdentifierCache(&parser.identifiers);
+	parser.source = lazy->source;
+
+	ClassCompiler * enclosingClass = currentClass;
+	ClassCompiler classCompiler;
+
+	if (lazy->inClass)
+	{
+		// Only needed to validate 'this' and 'super'
+
+		classCompiler.enclosing = NULL;
+		classCompiler.name = syntheticToken("");
+		classCompiler.hasSuperclass = lazy->hasSuperclass;
+		currentClass = &classCompiler;
+	}
+
+	// Parameters are parsed again, which recounts the arity
+
+	function->arity = 0;
+
+	Compiler compiler;
+	initCompiler(&compiler, &scanner, &parser, lazy->type, function);
+	compiler.lazy = lazy;
+
+	advance();
+
+	functionParameters();
+	consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+	block();
+
+	endCompiler();
+
+	freeArena(&parser.arena);
+
+	currentClass = enclosingClass;
+
+	if (parser.hadError)
+	{
+		freeChunk(&function->chunk);
+		return false;
+	}
+
+	function->lazy = NULL;
+	freeLazyFunction(lazy);
+
+	return true;
+}
+
+void freeLazyFunction(LazyFunction * lazy)
+{
+	if (lazy == NULL)
+		return;
+
+	releaseSourceBuffer(lazy->source);
+	ARY_FREE(lazy->aryUpvalueName);
+	FREE(LazyFunction, lazy);
+}
+
+static inline void lockShared(void)
+{
+	// Guards VM state touched while compiling: the string table, the object list and the value stack
+
+	if (vm.multithreaded)
+	{
+		lockMutex(s_queue.mutex);
+	}
+}
+
+static inline void unlockShared(void)
+{
+	if (vm.multithreaded)
+	{
+		unlockMutex(s_queue.mutex);
+	}
+}
+
+static void compileWorker(void * arg)
+{
+	UNUSED(arg);
+
+	lockMutex(s_queue.mutex);
+
+	for (;;)
+	{
+		while (ARY_EMPTY(s_queue.aryFunction) && s_queue.cBusy > 0)
+		{
+			waitCondVar(s_queue.condvar, s_queue.mutex);
+		}
+
+		if (ARY_EMPTY(s_queue.aryFunction))
+			break;
+
+		ObjFunction * function = *ARY_TAIL(s_queue.aryFunction);
+		ARY_POP(s_queue.aryFunction);
+		s_queue.cBusy++;
+
+		unlockMutex(s_queue.mutex);
+
+		// Compiling a body queues stubs for any functions nested inside it
+
+		bool success = compileLazyFunction(function);
+
+		lockMutex(s_queue.mutex);
+
+		if (!success)
+		{
+			s_queue.hadError = true;
+		}
+
+		s_queue.cBusy--;
+		broadcastCondVar(s_queue.condvar);
+	}
+
+	unlockMutex(s_queue.mutex);
+}
+
+static bool compileQueuedFunctions(void)
+{
+	int cThread = (COMPILER_THREADS > 0) ? COMPILER_THREADS : getProcessorCount();
+
+	// Every queued stub is reachable from the script function, but a collection can't run while
+	//  other threads are touching the heap. It's deferred until all the bodies are compiled.
+
+	s_queue.mutex = newMutex();
+	s_queue.condvar = newCondVar();
+	s_queue.cBusy = 0;
+	s_queue.hadError = false;
+
+	vm.multithreaded = true;
+
+	Thread ** aryThread = NULL;
+
+	for (int i = 1; i < cThread; ++i)
+	{
+		Thread * thread = startThread(compileWorker, NULL);
+
+		if (thread == NULL)
+			break;
+
+		ARY_PUSH(aryThread, thread);
+	}
+
+	// This thread works through the queue too
+
+	compileWorker(NULL);
+
+	for (uint32_t i = 0; i < ARY_LEN(aryThread); ++i)
+	{
+		joinThread(aryThread[i]);
+	}
+
+	vm.multithreaded = false;
+
+	// The workers only kept vm.bytesAllocated up to date, catch the high water mark up now
+
+	vm.bytesAllocatedMax = MAX(vm.bytesAllocated, vm.bytesAllocatedMax);
+
+	ARY_FREE(aryThread);
+	freeCondVar(s_queue.condvar);
+	freeMutex(s_queue.mutex);
+
+	return !s_queue.hadError;
+}
+
 static void advance(void)
 {
 	current->parser->previous = current->parser->current;
@@ -189,6 +470,11 @@ static void errorAt(Token * token, const char * message)
 
 	current->parser->panicMode = true;
 
+	// Keep each message on one line when bodies are compiled in parallel
+
+	lockShared();
+
+	flushOutput();
 	fprintf(stderr, "[line %d] Error", token->line);
 
 	if (token->type == TOKEN_EOF)
@@ -206,6 +492,8 @@ static void errorAt(Token * token, const char * message)
 
 	fprintf(stderr, ": %s\n", message);
 
+	unlockShared();
+
 	current->parser->hadError = true;
 }
 
@@ -329,9 +617,11 @@ static void emitReturn(void)
 
 static uint32_t makeConstant(Value value)
 {
-	// TODO: De-duplicate equivalent constants added to the chunk
+	// addConstant roots the value on the VM stack
 
-	uint32_t constant = addConstant(currentChunk(), value);
+	lockShared();
+	uint32_t constant = addConstant(currentChunk(), &current->constantIndex, value);
+	unlockShared();
 
 	if (constant > UINT24_MAX)
 	{
@@ -384,7 +674,7 @@ static void patchJump(uint32_t offset)
 	currentChunk()->aryB[offset + 1] = jump & 0xff;
 }
 
-static void initCompiler(Compiler * compiler, Scanner * scanner, Parser * parser, FunctionType type)
+static void initCompiler(Compiler * compiler, Scanner * scanner, Parser * parser, FunctionType type, ObjFunction * function)
 {
 	compiler->enclosing = current;
 	compiler->scanner = scanner;
@@ -393,15 +683,34 @@ static void initCompiler(Compiler * compiler, Scanner * scanner, Parser * parser
 	compiler->locals = NULL;
 	compiler->upvalues = NULL;
 	compiler->scopeDepth = 0;
+	initConstantIndex(&compiler->constantIndex, &parser->arena);
+	compiler->id = ++parser->cCompiler;
+	compiler->lazy = NULL;
 	compiler->function = NULL;
-	compiler->function = newFunction();
 	current = compiler;
 
-	if (type != TYPE_SCRIPT)
+	if (function == NULL)
+	{
+		lockShared();
+
+		compiler->function = newFunction();
+
+		if (type != TYPE_SCRIPT)
+		{
+			Token * name = &compiler->parser->previous;
+			compiler->function->name = sourceString(name->start, name->length, name->hash);
+		}
+
+		unlockShared();
+	}
+	else
 	{
-		current->function->name = copyString(current->parser->previous.start, current->parser->previous.length);
+		compiler->function = function;
 	}
 
+	ASSERT(ARY_EMPTY(compiler->function->chunk.aryB));
+	compiler->function->chunk.arena = &parser->arena;
+
 	Local local;
 	local.depth = 0;
 	local.isCaptured = false;
@@ -417,7 +726,7 @@ static void initCompiler(Compiler * compiler, Scanner * scanner, Parser * parser
 		local.name.length = 0;
 	}
 
-	ARY_PUSH(current->locals, local);
+	ARENA_ARY_PUSH(&current->parser->arena, current->locals, local);
 }
 
 static ObjFunction * endCompiler(void)
@@ -425,12 +734,19 @@ static ObjFunction * endCompiler(void)
 	emitReturn();
 	ObjFunction * function = current->function;
 
+	// The constant pool is complete, the index is only needed while emitting. The chunk
+	//  itself is copied out of the arena into buffers that are exactly big enough.
+
+	freeConstantIndex(&current->constantIndex);
+	finishChunk(currentChunk());
+
 #if DEBUG_PRINT_CODE
 	if (!current->parser->hadError)
 	{
 		disassembleChunk(
 			currentChunk(),
-			function->name != NULL ? function->name->aChars : "<script>");
+			function->name != NULL ? function->name->aChars : "<script>",
+			function->name != NULL ? function->name->length : 8);
 	}
 #endif
 
@@ -439,12 +755,6 @@ static ObjFunction * endCompiler(void)
 	return function;
 }
 
-static void destroyCompiler(Compiler * compiler)
-{
-	ARY_FREE(compiler->locals);
-	ARY_FREE(compiler->upvalues);
-}
-
 static void beginScope(void)
 {
 	current->scopeDepth++;
@@ -556,6 +866,64 @@ static void dot(bool canAssign)
 	}
 }
 
+static void listLiteral(bool canAssign)
+{
+	UNUSED(canAssign);
+
+	// OP_LIST has an 8-bit count, so long literals are built 255 elements at a time
+	//  with OP_LIST_APPEND adding each later batch onto the list made by the first
+
+	int cPending = 0;
+	bool fListEmitted = false;
+
+	if (!check(TOKEN_RIGHT_BRACKET))
+	{
+		do
+		{
+			if (check(TOKEN_RIGHT_BRACKET))
+				break; // Trailing comma
+
+			expression();
+			cPending++;
+
+			if (cPending == UINT8_MAX)
+			{
+				emitBytes(fListEmitted ? OP_LIST_APPEND : OP_LIST, (uint8_t)cPending);
+				fListEmitted = true;
+				cPending = 0;
+			}
+		}
+		while (match(TOKEN_COMMA));
+	}
+
+	consume(TOKEN_RIGHT_BRACKET, "Expect ']' after list elements.");
+
+	if (!fListEmitted)
+	{
+		emitBytes(OP_LIST, (uint8_t)cPending);
+	}
+	else if (cPending > 0)
+	{
+		emitBytes(OP_LIST_APPEND, (uint8_t)cPending);
+	}
+}
+
+static void subscript(bool canAssign)
+{
+	expression();
+	consume(TOKEN_RIGHT_BRACKET, "Expect ']' after index.");
+
+	if (canAssign && match(TOKEN_EQUAL))
+	{
+		expression();
+		emitByte(OP_INDEX_SET);
+	}
+	else
+	{
+		emitByte(OP_INDEX_GET);
+	}
+}
+
 static void literal(bool canAssign)
 {
 	UNUSED(canAssign);
@@ -582,15 +950,36 @@ static void number(bool canAssign)
 {
 	UNUSED(canAssign);
 
-	double value = strtod(current->parser->previous.start, NULL);
-	emitConstant(NUMBER_VAL(value));
+	Token * token = &current->parser->previous;
+	double value = (token->isInteger) ? parseInteger(token->start, token->length) : parseNumber(token->start, token->length);
+	emitConstant(NUMBER_VAL_NARROW(value));
+}
+
+static ObjString * sourceString(const char * chars, int length, uint32_t hash)
+{
+	// Caller holds the shared lock. Synthetic tokens like 'this' aren't in the source, so
+	//  those still get copied.
+
+	SourceBuffer * src = current->parser->source;
+
+	if (isInSourceBuffer(src, chars, length))
+		return copyStringStatic(src, chars, length, hash);
+
+	return copyStringWithHash(chars, length, hash);
 }
 
 static void string(bool canAssign)
 {
 	UNUSED(canAssign);
 
-	emitConstant(OBJ_VAL(copyString(current->parser->previous.start + 1, current->parser->previous.length - 2)));
+	const char * chars = current->parser->previous.start + 1;
+	int length = current->parser->previous.length - 2;
+
+	lockShared();
+	ObjString * str = sourceString(chars, length, hashString(chars, length));
+	unlockShared();
+
+	emitConstant(OBJ_VAL(str));
 }
 
 static void and_(bool canAssign)
@@ -670,6 +1059,7 @@ static Token syntheticToken(const char* text)
 	Token token;
 	token.start = text;
 	token.length = (int)strlen(text);
+	token.hash = hashString(text, token.length);
 	return token;
 }
 
@@ -747,6 +1137,8 @@ static const ParseRule rules[] =
 	{ NULL,     NULL,    PREC_NONE },       // TOKEN_RIGHT_PAREN
 	{ NULL,     NULL,    PREC_NONE },       // TOKEN_LEFT_BRACE
 	{ NULL,     NULL,    PREC_NONE },       // TOKEN_RIGHT_BRACE
+	{ listLiteral, subscript, PREC_CALL },  // TOKEN_LEFT_BRACKET
+	{ NULL,     NULL,    PREC_NONE },       // TOKEN_RIGHT_BRACKET
 	{ NULL,     NULL,    PREC_NONE },       // TOKEN_COMMA
 	{ NULL,     dot,     PREC_CALL },       // TOKEN_DOT
 	{ unary,    binary,  PREC_TERM },       // TOKEN_MINUS
@@ -813,9 +1205,98 @@ static void parsePrecedence(Precedence precedence)
 	}
 }
 
+static void initIdentifierCache(IdentifierCache * identc)
+{
+	identc->count = 0;
+	identc->capacityMask = -1;
+	identc->aIdent = NULL;
+}
+
+static IdentifierEntry * findIdentifierEntry(IdentifierCache * identc, Token * name)
+{
+	ASSERT(identc->aIdent != NULL);
+
+	uint32_t index = name->hash & identc->capacityMask;
+
+	for (;;)
+	{
+		IdentifierEntry * ident = &identc->aIdent[index];
+
+		if (ident->str == NULL ||
+			(ident->str->hash == name->hash &&
+			 ident->str->length == name->length &&
+			 memcmp(ident->str->aChars, name->start, name->length) == 0))
+		{
+			return ident;
+		}
+
+		index = (index + 1) & identc->capacityMask;
+	}
+}
+
+static void adjustIdentifierCacheCapacity(Arena * arena, IdentifierCache * identc, int capacityMask)
+{
+	ASSERT(IS_POW2(capacityMask + 1));
+
+	IdentifierEntry * aIdentOld = identc->aIdent;
+	int capacityOld = identc->capacityMask + 1;
+
+	identc->aIdent = allocArena(arena, sizeof(IdentifierEntry) * (capacityMask + 1));
+	identc->capacityMask = capacityMask;
+
+	memset(identc->aIdent, 0, sizeof(IdentifierEntry) * (capacityMask + 1));
+
+	for (int iIdent = 0; iIdent < capacityOld; ++iIdent)
+	{
+		IdentifierEntry * identOld = &aIdentOld[iIdent];
+		if (identOld->str == NULL)
+			continue;
+
+		uint32_t index = identOld->str->hash & capacityMask;
+
+		while (identc->aIdent[index].str != NULL)
+		{
+			index = (index + 1) & capacityMask;
+		}
+
+		identc->aIdent[index] = *identOld;
+	}
+}
+
 static uint32_t identifierConstant(Token * name)
 {
-	return makeConstant(OBJ_VAL(copyString(name->start, name->length)));
+	ASSERT(name->hash == hashString(name->start, name->length));
+
+	IdentifierCache * identc = &current->parser->identifiers;
+	int capacity = identc->capacityMask + 1;
+
+	if (identc->count + 1 > (capacity >> 1))
+	{
+		adjustIdentifierCacheCapacity(&current->parser->arena, identc, (capacity < 64 ? 64 : capacity * 2) - 1);
+	}
+
+	IdentifierEntry * ident = findIdentifierEntry(identc, name);
+
+	if (ident->str == NULL)
+	{
+		lockShared();
+		ident->str = sourceString(name->start, name->length, name->hash);
+		unlockShared();
+
+		ident->idCompiler = 0;
+		identc->count++;
+	}
+
+	// Constant indices are per chunk, so only reuse one added by this same compiler. The cache
+	//  is marked as a root, so the string is safe if adding the constant collects garbage
+
+	if (ident->idCompiler != current->id)
+	{
+		ident->constant = makeConstant(OBJ_VAL(ident->str));
+		ident->idCompiler = current->id;
+	}
+
+	return ident->constant;
 }
 
 static bool identifiersEqual(Token * a, Token * b)
@@ -869,15 +1350,30 @@ static uint32_t addUpvalue(Compiler * compiler, uint32_t index, bool isLocal)
 	Upvalue upvalue;
 	upvalue.isLocal = isLocal;
 	upvalue.index = index;
-	ARY_PUSH(compiler->upvalues, upvalue);
+	ARENA_ARY_PUSH(&compiler->parser->arena, compiler->upvalues, upvalue);
 	compiler->function->upvalueCount++;
 
 	return ARY_LEN(compiler->upvalues) - 1;
 }
 
+static bool resolveLazyUpvalue(LazyFunction * lazy, Token * name, uint32_t * upvalueIndex)
+{
+	for (uint32_t i = 0; i < ARY_LEN(lazy->aryUpvalueName); ++i)
+	{
+		if (identifiersEqual(name, &lazy->aryUpvalueName[i]))
+		{
+			*upvalueIndex = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
 static bool resolveUpvalue(Compiler * compiler, Token* name, uint32_t* upvalueIndex)
 {
-	if (compiler->enclosing == NULL) return false;
+	if (compiler->enclosing == NULL)
+		return compiler->lazy != NULL && resolveLazyUpvalue(compiler->lazy, name, upvalueIndex);
 
 	uint32_t localIndex;
 	if (resolveLocal(compiler->enclosing, name, &localIndex))
@@ -912,7 +1408,7 @@ static void addLocal(Token name)
 	local.name = name;
 	local.depth = -1;
 	local.isCaptured = false;
-	ARY_PUSH(current->locals, local);
+	ARENA_ARY_PUSH(&current->parser->arena, current->locals, local);
 }
 
 static void declareVariable(void)
@@ -1022,14 +1518,10 @@ static void block(void)
 	consume(TOKEN_RIGHT_BRACE, "Expect '}' after block.");
 }
 
-static void function(FunctionType type)
+static void functionParameters(void)
 {
-	Compiler compiler;
-	initCompiler(&compiler, current->scanner, current->parser, type);
 	beginScope();
 
-	// Compile the parameter list
-
 	consume(TOKEN_LEFT_PAREN, "Expect '(' after function name.");
 
 	if (!check(TOKEN_RIGHT_PAREN))
@@ -1050,29 +1542,25 @@ static void function(FunctionType type)
 	}
 
 	consume(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
+}
 
-	// The body
-
-	consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
-	block();
-
+static void emitClosure(ObjFunction * function, Upvalue * aryUpvalue)
+{
 	// Create the runtime closure object pointing to the compiled function
 
-	ObjFunction * function = endCompiler();
-
 	uint32_t constant = makeConstant(OBJ_VAL(function));
 	emitConstantHelper(constant, OP_CLOSURE, OP_CLOSURE_LONG);
 
 	uint32_t upvalueCount = function->upvalueCount;
-	ASSERT(upvalueCount == ARY_LEN(compiler.upvalues));
+	ASSERT(upvalueCount == ARY_LEN(aryUpvalue));
 
 	for (uint32_t i = 0; i < upvalueCount; ++i)
 	{
-		uint32_t index = compiler.upvalues[i].index;
+		uint32_t index = aryUpvalue[i].index;
 		bool longInstruction = (index > UINT8_MAX);
 
 		uint8_t flag = 0;
-		if (compiler.upvalues[i].isLocal) flag |= 0x1;
+		if (aryUpvalue[i].isLocal) flag |= 0x1;
 		if (longInstruction) flag |= 0x2;
 
 		emitByte(flag);
@@ -1086,8 +1574,386 @@ static void function(FunctionType type)
 			emitByte((uint8_t)index);
 		}
 	}
+}
+
+static void captureLazyName(Token name)
+{
+	uint32_t index;
+	if (resolveLocal(current, &name, &index))
+		return;
+
+	if (resolveUpvalue(current, &name, &index) && index == ARY_LEN(current->function->lazy->aryUpvalueName))
+	{
+		ARY_PUSH(current->function->lazy->aryUpvalueName, name);
+	}
+}
+
+// Skimming walks the statement structure of a function body without generating any code. It
+//  tracks the names declared in each scope of the body, so that exactly the names the full
+//  compiler would capture from enclosing functions are captured, in the same order.
+
+static void skimDeclare(Skimmer * skimmer, Token name)
+{
+	ARENA_ARY_PUSH(&current->parser->arena, skimmer->aryName, name);
+}
+
+static void skimReference(Skimmer * skimmer, Token name)
+{
+	for (int i = ARY_LEN(skimmer->aryName) - 1; i >= 0; i--)
+	{
+		if (identifiersEqual(&name, &skimmer->aryName[i]))
+			return;
+	}
+
+	captureLazyName(name);
+}
+
+static void skimBeginScope(Skimmer * skimmer)
+{
+	ARENA_ARY_PUSH(&current->parser->arena, skimmer->aryScopeStart, ARY_LEN(skimmer->aryName));
+}
 
-	destroyCompiler(&compiler);
+static void skimEndScope(Skimmer * skimmer)
+{
+	uint32_t start = *ARY_TAIL(skimmer->aryScopeStart);
+	ARY_POP(skimmer->aryScopeStart);
+
+	while (ARY_LEN(skimmer->aryName) > start)
+	{
+		ARY_POP(skimmer->aryName);
+	}
+}
+
+static void skimExpression(Skimmer * skimmer)
+{
+	// Stops before a ';' or unbalanced ')', or any brace
+
+	int depth = 0;
+	TokenType typePrev = TOKEN_ERROR;
+
+	for (;;)
+	{
+		TokenType type = current->parser->current.type;
+
+		if (type == TOKEN_EOF || type == TOKEN_LEFT_BRACE || type == TOKEN_RIGHT_BRACE)
+			return;
+
+		if (depth == 0 && (type == TOKEN_SEMICOLON || type == TOKEN_RIGHT_PAREN))
+			return;
+
+		advance();
+
+		switch (type)
+		{
+			case TOKEN_LEFT_PAREN:	depth++; break;
+			case TOKEN_RIGHT_PAREN:	depth--; break;
+			case TOKEN_LEFT_BRACKET:	depth++; break;
+			case TOKEN_RIGHT_BRACKET:	depth--; break;
+			case TOKEN_THIS:		skimReference(skimmer, syntheticToken("this")); break;
+
+			case TOKEN_IDENTIFIER:
+				if (typePrev != TOKEN_DOT)
+				{
+					skimReference(skimmer, current->parser->previous);
+				}
+				break;
+
+			case TOKEN_SUPER:
+				// Matches the order super_ resolves things in: 'this', then any arguments, then 'super'
+
+				match(TOKEN_DOT);
+				match(TOKEN_IDENTIFIER);
+				skimReference(skimmer, syntheticToken("this"));
+
+				if (match(TOKEN_LEFT_PAREN))
+				{
+					skimExpression(skimmer);
+					match(TOKEN_RIGHT_PAREN);
+				}
+
+				skimReference(skimmer, syntheticToken("super"));
+				break;
+
+			default:
+				break;
+		}
+
+		typePrev = current->parser->previous.type;
+	}
+}
+
+static void skimBlock(Skimmer * skimmer);
+static void skimDeclaration(Skimmer * skimmer);
+
+static void skimFunction(Skimmer * skimmer, bool isMethod)
+{
+	skimBeginScope(skimmer);
+
+	if (isMethod)
+	{
+		skimDeclare(skimmer, syntheticToken("this"));
+	}
+
+	if (match(TOKEN_LEFT_PAREN))
+	{
+		while (match(TOKEN_IDENTIFIER))
+		{
+			skimDeclare(skimmer, current->parser->previous);
+
+			if (!match(TOKEN_COMMA))
+				break;
+		}
+
+		match(TOKEN_RIGHT_PAREN);
+	}
+
+	if (match(TOKEN_LEFT_BRACE))
+	{
+		skimBlock(skimmer);
+	}
+
+	skimEndScope(skimmer);
+}
+
+static void skimVarDeclaration(Skimmer * skimmer)
+{
+	// Declared before the initializer, like declareVariable
+
+	if (match(TOKEN_IDENTIFIER))
+	{
+		skimDeclare(skimmer, current->parser->previous);
+	}
+
+	if (match(TOKEN_EQUAL))
+	{
+		skimExpression(skimmer);
+	}
+
+	match(TOKEN_SEMICOLON);
+}
+
+static void skimStatement(Skimmer * skimmer)
+{
+	if (match(TOKEN_FOR))
+	{
+		skimBeginScope(skimmer);
+
+		match(TOKEN_LEFT_PAREN);
+
+		if (match(TOKEN_VAR))
+		{
+			skimVarDeclaration(skimmer);
+		}
+		else if (!match(TOKEN_SEMICOLON))
+		{
+			skimExpression(skimmer);
+			match(TOKEN_SEMICOLON);
+		}
+
+		skimExpression(skimmer);
+		match(TOKEN_SEMICOLON);
+		skimExpression(skimmer);
+		match(TOKEN_RIGHT_PAREN);
+
+		skimStatement(skimmer);
+
+		skimEndScope(skimmer);
+	}
+	else if (match(TOKEN_IF) || match(TOKEN_WHILE))
+	{
+		bool isIf = (current->parser->previous.type == TOKEN_IF);
+
+		match(TOKEN_LEFT_PAREN);
+		skimExpression(skimmer);
+		match(TOKEN_RIGHT_PAREN);
+
+		skimStatement(skimmer);
+
+		if (isIf && match(TOKEN_ELSE))
+		{
+			skimStatement(skimmer);
+		}
+	}
+	else if (match(TOKEN_LEFT_BRACE))
+	{
+		skimBeginScope(skimmer);
+		skimBlock(skimmer);
+		skimEndScope(skimmer);
+	}
+	else
+	{
+		// print, return and expression statements
+
+		if (!match(TOKEN_PRINT))
+		{
+			match(TOKEN_RETURN);
+		}
+
+		skimExpression(skimmer);
+
+		// Always make progress, even on malformed code
+
+		if (!match(TOKEN_SEMICOLON))
+		{
+			match(TOKEN_RIGHT_PAREN);
+		}
+	}
+}
+
+static void skimClassDeclaration(Skimmer * skimmer)
+{
+	if (match(TOKEN_IDENTIFIER))
+	{
+		skimDeclare(skimmer, current->parser->previous);
+	}
+
+	bool hasSuperclass = false;
+
+	if (match(TOKEN_LESS))
+	{
+		if (match(TOKEN_IDENTIFIER))
+		{
+			skimReference(skimmer, current->parser->previous);
+		}
+
+		skimBeginScope(skimmer);
+		skimDeclare(skimmer, syntheticToken("super"));
+		hasSuperclass = true;
+	}
+
+	if (match(TOKEN_LEFT_BRACE))
+	{
+		while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF))
+		{
+			if (match(TOKEN_IDENTIFIER))
+			{
+				skimFunction(skimmer, true);
+			}
+			else
+			{
+				advance();
+			}
+		}
+
+		match(TOKEN_RIGHT_BRACE);
+	}
+
+	if (hasSuperclass)
+	{
+		skimEndScope(skimmer);
+	}
+}
+
+static void skimDeclaration(Skimmer * skimmer)
+{
+	if (match(TOKEN_CLASS))
+	{
+		skimClassDeclaration(skimmer);
+	}
+	else if (match(TOKEN_FUN))
+	{
+		if (match(TOKEN_IDENTIFIER))
+		{
+			skimDeclare(skimmer, current->parser->previous);
+		}
+
+		skimFunction(skimmer, false);
+	}
+	else if (match(TOKEN_VAR))
+	{
+		skimVarDeclaration(skimmer);
+	}
+	else
+	{
+		skimStatement(skimmer);
+	}
+}
+
+static void skimBlock(Skimmer * skimmer)
+{
+	while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF))
+	{
+		skimDeclaration(skimmer);
+	}
+
+	match(TOKEN_RIGHT_BRACE);
+}
+
+static void lazyFunction(FunctionType type)
+{
+	ASSERT(current->parser->source != NULL);
+
+	Compiler compiler;
+	initCompiler(&compiler, current->scanner, current->parser, type, NULL);
+
+	LazyFunction * lazy = ALLOCATE(LazyFunction, 1);
+	lazy->source = retainSourceBuffer(current->parser->source);
+	lazy->start = current->parser->current.start;
+	lazy->line = current->parser->current.line;
+	lazy->type = type;
+	lazy->inClass = (currentClass != NULL);
+	lazy->hasSuperclass = (currentClass != NULL && currentClass->hasSuperclass);
+	lazy->aryUpvalueName = NULL;
+	compiler.function->lazy = lazy;
+
+	functionParameters();
+
+	// Skim the body, only resolving the names it captures. The bytecode is generated by
+	//  compileLazyFunction, either the first time the function is called or by a worker thread.
+
+	consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+
+	Skimmer skimmer;
+	skimmer.aryName = NULL;
+	skimmer.aryScopeStart = NULL;
+
+	while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF))
+	{
+		skimDeclaration(&skimmer);
+	}
+
+	consume(TOKEN_RIGHT_BRACE, "Expect '}' after block.");
+
+	// The stub has no code of its own, but its chunk still needs to leave the arena
+
+	finishChunk(&compiler.function->chunk);
+
+	current = current->enclosing;
+
+	emitClosure(compiler.function, compiler.upvalues);
+
+	if (PARALLEL_FUNCTIONS)
+	{
+		// The stub is rooted by the constant emitClosure just added
+
+		lockShared();
+		ARY_PUSH(s_queue.aryFunction, compiler.function);
+		if (vm.multithreaded) broadcastCondVar(s_queue.condvar);
+		unlockShared();
+	}
+}
+
+static void function(FunctionType type)
+{
+	if (SKIM_FUNCTIONS)
+	{
+		lazyFunction(type);
+		return;
+	}
+
+	Compiler compiler;
+	initCompiler(&compiler, current->scanner, current->parser, type, NULL);
+
+	functionParameters();
+
+	// The body
+
+	consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+	block();
+
+	ObjFunction * function = endCompiler();
+
+	emitClosure(function, compiler.upvalues);
 }
 
 static void method(void)
@@ -1402,6 +2268,16 @@ static void ifStatement(void)
 
 void markCompilerRoots(void)
 {
+	if (current != NULL)
+	{
+		IdentifierCache * identc = &current->parser->identifiers;
+
+		for (int iIdent = 0; iIdent <= identc->capacityMask; ++iIdent)
+		{
+			markObject((Obj*)identc->aIdent[iIdent].str);
+		}
+	}
+
 	Compiler* compiler = current;
 
 	while (compiler != NULL)
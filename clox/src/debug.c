@@ -15,9 +15,9 @@
 #include "value.h"
 #include "array.h"
 
-void disassembleChunk(Chunk * chunk, const char * name)
+void disassembleChunk(Chunk * chunk, const char * name, int nameLength)
 {
-	printf("== %s ==\n", name);
+	printf("== %.*s ==\n", nameLength, name);
 
 	for (unsigned i = 0; i < ARY_LEN(chunk->aryB);)
 	{
@@ -265,6 +265,14 @@ unsigned disassembleInstruction(Chunk * chunk, unsigned offset)
 			return constantInstruction("OP_METHOD", chunk, offset, false);
 		case OP_METHOD_LONG:
 			return constantInstruction("OP_METHOD_LONG", chunk, offset, true);
+		case OP_LIST:
+			return immediateInstruction("OP_LIST", chunk, offset, false);
+		case OP_LIST_APPEND:
+			return immediateInstruction("OP_LIST_APPEND", chunk, offset, false);
+		case OP_INDEX_GET:
+			return simpleInstruction("OP_INDEX_GET", offset);
+		case OP_INDEX_SET:
+			return simpleInstruction("OP_INDEX_SET", offset);
 		default:
 			printf("Unknown opcode %d\n", instruction);
 			return offset + 1;
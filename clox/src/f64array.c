@@ -0,0 +1,585 @@
+//
+//  f64array.c
+//  clox
+//
+
+#include "f64array.h"
+
+#include <math.h>
+
+#if F64ARRAY_SIMD && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#define F64_X86 1
+#else
+#define F64_X86 0
+#endif
+
+#if F64_X86 && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define F64_SSE2 1
+#else
+#define F64_SSE2 0
+#endif
+
+// The AVX2 kernels are always built on x86 and only called if CPUID says the
+//  processor has AVX2. MSVC allows AVX intrinsics anywhere, GCC and Clang need each function marked.
+
+#define F64_AVX2 F64_X86
+
+#if F64_X86
+#include <immintrin.h>
+#endif
+
+#if TARGET_WINDOWS
+#include <intrin.h>
+#define F64_TARGET_AVX2
+#else
+#define F64_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+
+
+// Scalar
+
+static void addScalar(double * aDst, const double * aA, const double * aB, uint32_t c)
+{
+	for (uint32_t i = 0; i < c; ++i)
+	{
+		aDst[i] = aA[i] + aB[i];
+	}
+}
+
+static void mulScalar(double * aDst, const double * aA, const double * aB, uint32_t c)
+{
+	for (uint32_t i = 0; i < c; ++i)
+	{
+		aDst[i] = aA[i] * aB[i];
+	}
+}
+
+static void axpyScalar(double * aY, double alpha, const double * aX, uint32_t c)
+{
+	for (uint32_t i = 0; i < c; ++i)
+	{
+		aY[i] += alpha * aX[i];
+	}
+}
+
+static void scaleScalar(double * aDst, const double * aA, double mul, double add, uint32_t c)
+{
+	for (uint32_t i = 0; i < c; ++i)
+	{
+		aDst[i] = aA[i] * mul + add;
+	}
+}
+
+static void fillScalar(double * aDst, double value, uint32_t c)
+{
+	for (uint32_t i = 0; i < c; ++i)
+	{
+		aDst[i] = value;
+	}
+}
+
+static void prefixSumScalar(double * aDst, const double * aA, uint32_t c)
+{
+	double sum = 0.0;
+
+	for (uint32_t i = 0; i < c; ++i)
+	{
+		sum += aA[i];
+		aDst[i] = sum;
+	}
+}
+
+static double sumScalar(const double * aA, uint32_t c)
+{
+	double sum = 0.0;
+
+	for (uint32_t i = 0; i < c; ++i)
+	{
+		sum += aA[i];
+	}
+
+	return sum;
+}
+
+static double dotScalar(const double * aA, const double * aB, uint32_t c)
+{
+	double sum = 0.0;
+
+	for (uint32_t i = 0; i < c; ++i)
+	{
+		sum += aA[i] * aB[i];
+	}
+
+	return sum;
+}
+
+// The min and max kernels are written as (x < m) ? x : m, which is exactly what
+//  MINPD does per lane, so every implementation skips NaNs the same way
+
+static double minScalar(const double * aA, uint32_t c)
+{
+	double m = INFINITY;
+
+	for (uint32_t i = 0; i < c; ++i)
+	{
+		m = (aA[i] < m) ? aA[i] : m;
+	}
+
+	return m;
+}
+
+static double maxScalar(const double * aA, uint32_t c)
+{
+	double m = -INFINITY;
+
+	for (uint32_t i = 0; i < c; ++i)
+	{
+		m = (aA[i] > m) ? aA[i] : m;
+	}
+
+	return m;
+}
+
+static const F64Kernels s_f64kScalar =
+{
+	"scalar",
+	addScalar,
+	mulScalar,
+	axpyScalar,
+	scaleScalar,
+	fillScalar,
+	prefixSumScalar,
+	sumScalar,
+	dotScalar,
+	minScalar,
+	maxScalar,
+};
+
+
+
+// SSE2, two lanes. Each kernel runs the vector loop and then finishes the last odd element
+//  with the scalar kernel.
+
+#if F64_SSE2
+
+static void addSse2(double * aDst, const double * aA, const double * aB, uint32_t c)
+{
+	uint32_t i = 0;
+
+	for (; i + 2 <= c; i += 2)
+	{
+		_mm_storeu_pd(&aDst[i], _mm_add_pd(_mm_loadu_pd(&aA[i]), _mm_loadu_pd(&aB[i])));
+	}
+
+	addScalar(&aDst[i], &aA[i], &aB[i], c - i);
+}
+
+static void mulSse2(double * aDst, const double * aA, const double * aB, uint32_t c)
+{
+	uint32_t i = 0;
+
+	for (; i + 2 <= c; i += 2)
+	{
+		_mm_storeu_pd(&aDst[i], _mm_mul_pd(_mm_loadu_pd(&aA[i]), _mm_loadu_pd(&aB[i])));
+	}
+
+	mulScalar(&aDst[i], &aA[i], &aB[i], c - i);
+}
+
+static void axpySse2(double * aY, double alpha, const double * aX, uint32_t c)
+{
+	__m128d vAlpha = _mm_set1_pd(alpha);
+	uint32_t i = 0;
+
+	for (; i + 2 <= c; i += 2)
+	{
+		__m128d vY = _mm_add_pd(_mm_loadu_pd(&aY[i]), _mm_mul_pd(vAlpha, _mm_loadu_pd(&aX[i])));
+		_mm_storeu_pd(&aY[i], vY);
+	}
+
+	axpyScalar(&aY[i], alpha, &aX[i], c - i);
+}
+
+static void scaleSse2(double * aDst, const double * aA, double mul, double add, uint32_t c)
+{
+	__m128d vMul = _mm_set1_pd(mul);
+	__m128d vAdd = _mm_set1_pd(add);
+	uint32_t i = 0;
+
+	for (; i + 2 <= c; i += 2)
+	{
+		_mm_storeu_pd(&aDst[i], _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(&aA[i]), vMul), vAdd));
+	}
+
+	scaleScalar(&aDst[i], &aA[i], mul, add, c - i);
+}
+
+static void fillSse2(double * aDst, double value, uint32_t c)
+{
+	__m128d v = _mm_set1_pd(value);
+	uint32_t i = 0;
+
+	for (; i + 2 <= c; i += 2)
+	{
+		_mm_storeu_pd(&aDst[i], v);
+	}
+
+	fillScalar(&aDst[i], value, c - i);
+}
+
+static void prefixSumSse2(double * aDst, const double * aA, uint32_t c)
+{
+	// [a0, a1] + [0, a0] gives the sums within the pair, then the running total is added to both
+
+	__m128d vCarry = _mm_setzero_pd();
+	uint32_t i = 0;
+
+	for (; i + 2 <= c; i += 2)
+	{
+		__m128d v = _mm_loadu_pd(&aA[i]);
+		v = _mm_add_pd(v, _mm_castsi128_pd(_mm_slli_si128(_mm_castpd_si128(v), 8)));
+		v = _mm_add_pd(v, vCarry);
+		_mm_storeu_pd(&aDst[i], v);
+		vCarry = _mm_unpackhi_pd(v, v);
+	}
+
+	if (i < c)
+	{
+		aDst[i] = _mm_cvtsd_f64(vCarry) + aA[i];
+	}
+}
+
+static inline double hsumSse2(__m128d v)
+{
+	return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+static double sumSse2(const double * aA, uint32_t c)
+{
+	// Two accumulators so consecutive adds don't wait on each other
+
+	__m128d vSum0 = _mm_setzero_pd();
+	__m128d vSum1 = _mm_setzero_pd();
+	uint32_t i = 0;
+
+	for (; i + 4 <= c; i += 4)
+	{
+		vSum0 = _mm_add_pd(vSum0, _mm_loadu_pd(&aA[i]));
+		vSum1 = _mm_add_pd(vSum1, _mm_loadu_pd(&aA[i + 2]));
+	}
+
+	return hsumSse2(_mm_add_pd(vSum0, vSum1)) + sumScalar(&aA[i], c - i);
+}
+
+static double dotSse2(const double * aA, const double * aB, uint32_t c)
+{
+	__m128d vSum0 = _mm_setzero_pd();
+	__m128d vSum1 = _mm_setzero_pd();
+	uint32_t i = 0;
+
+	for (; i + 4 <= c; i += 4)
+	{
+		vSum0 = _mm_add_pd(vSum0, _mm_mul_pd(_mm_loadu_pd(&aA[i]), _mm_loadu_pd(&aB[i])));
+		vSum1 = _mm_add_pd(vSum1, _mm_mul_pd(_mm_loadu_pd(&aA[i + 2]), _mm_loadu_pd(&aB[i + 2])));
+	}
+
+	return hsumSse2(_mm_add_pd(vSum0, vSum1)) + dotScalar(&aA[i], &aB[i], c - i);
+}
+
+static double minSse2(const double * aA, uint32_t c)
+{
+	__m128d vMin = _mm_set1_pd(INFINITY);
+	uint32_t i = 0;
+
+	for (; i + 2 <= c; i += 2)
+	{
+		vMin = _mm_min_pd(_mm_loadu_pd(&aA[i]), vMin);
+	}
+
+	vMin = _mm_min_sd(_mm_unpackhi_pd(vMin, vMin), vMin);
+	double mTail = minScalar(&aA[i], c - i);
+	double m = _mm_cvtsd_f64(vMin);
+
+	return (mTail < m) ? mTail : m;
+}
+
+static double maxSse2(const double * aA, uint32_t c)
+{
+	__m128d vMax = _mm_set1_pd(-INFINITY);
+	uint32_t i = 0;
+
+	for (; i + 2 <= c; i += 2)
+	{
+		vMax = _mm_max_pd(_mm_loadu_pd(&aA[i]), vMax);
+	}
+
+	vMax = _mm_max_sd(_mm_unpackhi_pd(vMax, vMax), vMax);
+	double mTail = maxScalar(&aA[i], c - i);
+	double m = _mm_cvtsd_f64(vMax);
+
+	return (mTail > m) ? mTail : m;
+}
+
+static const F64Kernels s_f64kSse2 =
+{
+	"sse2",
+	addSse2,
+	mulSse2,
+	axpySse2,
+	scaleSse2,
+	fillSse2,
+	prefixSumSse2,
+	sumSse2,
+	dotSse2,
+	minSse2,
+	maxSse2,
+};
+
+#endif // F64_SSE2
+
+
+
+// AVX2, four lanes. Multiplies and adds are kept separate rather than fused so elementwise
+//  results match the other implementations exactly.
+
+#if F64_AVX2
+
+F64_TARGET_AVX2 static void addAvx2(double * aDst, const double * aA, const double * aB, uint32_t c)
+{
+	uint32_t i = 0;
+
+	for (; i + 4 <= c; i += 4)
+	{
+		_mm256_storeu_pd(&aDst[i], _mm256_add_pd(_mm256_loadu_pd(&aA[i]), _mm256_loadu_pd(&aB[i])));
+	}
+
+	addScalar(&aDst[i], &aA[i], &aB[i], c - i);
+}
+
+F64_TARGET_AVX2 static void mulAvx2(double * aDst, const double * aA, const double * aB, uint32_t c)
+{
+	uint32_t i = 0;
+
+	for (; i + 4 <= c; i += 4)
+	{
+		_mm256_storeu_pd(&aDst[i], _mm256_mul_pd(_mm256_loadu_pd(&aA[i]), _mm256_loadu_pd(&aB[i])));
+	}
+
+	mulScalar(&aDst[i], &aA[i], &aB[i], c - i);
+}
+
+F64_TARGET_AVX2 static void axpyAvx2(double * aY, double alpha, const double * aX, uint32_t c)
+{
+	__m256d vAlpha = _mm256_set1_pd(alpha);
+	uint32_t i = 0;
+
+	for (; i + 4 <= c; i += 4)
+	{
+		__m256d vY = _mm256_add_pd(_mm256_loadu_pd(&aY[i]), _mm256_mul_pd(vAlpha, _mm256_loadu_pd(&aX[i])));
+		_mm256_storeu_pd(&aY[i], vY);
+	}
+
+	axpyScalar(&aY[i], alpha, &aX[i], c - i);
+}
+
+F64_TARGET_AVX2 static void scaleAvx2(double * aDst, const double * aA, double mul, double add, uint32_t c)
+{
+	__m256d vMul = _mm256_set1_pd(mul);
+	__m256d vAdd = _mm256_set1_pd(add);
+	uint32_t i = 0;
+
+	for (; i + 4 <= c; i += 4)
+	{
+		_mm256_storeu_pd(&aDst[i], _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(&aA[i]), vMul), vAdd));
+	}
+
+	scaleScalar(&aDst[i], &aA[i], mul, add, c - i);
+}
+
+F64_TARGET_AVX2 static void fillAvx2(double * aDst, double value, uint32_t c)
+{
+	__m256d v = _mm256_set1_pd(value);
+	uint32_t i = 0;
+
+	for (; i + 4 <= c; i += 4)
+	{
+		_mm256_storeu_pd(&aDst[i], v);
+	}
+
+	fillScalar(&aDst[i], value, c - i);
+}
+
+F64_TARGET_AVX2 static void prefixSumAvx2(double * aDst, const double * aA, uint32_t c)
+{
+	// Log-step scan within the vector: shift up one lane and add, then shift up two lanes and add
+
+	__m256d vZero = _mm256_setzero_pd();
+	__m256d vCarry = vZero;
+	uint32_t i = 0;
+
+	for (; i + 4 <= c; i += 4)
+	{
+		__m256d v = _mm256_loadu_pd(&aA[i]);
+		v = _mm256_add_pd(v, _mm256_blend_pd(_mm256_permute4x64_pd(v, 0x93), vZero, 0x1));
+		v = _mm256_add_pd(v, _mm256_permute2f128_pd(v, v, 0x08));
+		v = _mm256_add_pd(v, vCarry);
+		_mm256_storeu_pd(&aDst[i], v);
+		vCarry = _mm256_permute4x64_pd(v, 0xff);
+	}
+
+	double sum = _mm_cvtsd_f64(_mm256_castpd256_pd128(vCarry));
+
+	for (; i < c; ++i)
+	{
+		sum += aA[i];
+		aDst[i] = sum;
+	}
+}
+
+F64_TARGET_AVX2 static inline double hsumAvx2(__m256d v)
+{
+	__m128d v2 = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(v2, _mm_unpackhi_pd(v2, v2)));
+}
+
+F64_TARGET_AVX2 static double sumAvx2(const double * aA, uint32_t c)
+{
+	__m256d vSum0 = _mm256_setzero_pd();
+	__m256d vSum1 = _mm256_setzero_pd();
+	uint32_t i = 0;
+
+	for (; i + 8 <= c; i += 8)
+	{
+		vSum0 = _mm256_add_pd(vSum0, _mm256_loadu_pd(&aA[i]));
+		vSum1 = _mm256_add_pd(vSum1, _mm256_loadu_pd(&aA[i + 4]));
+	}
+
+	return hsumAvx2(_mm256_add_pd(vSum0, vSum1)) + sumScalar(&aA[i], c - i);
+}
+
+F64_TARGET_AVX2 static double dotAvx2(const double * aA, const double * aB, uint32_t c)
+{
+	__m256d vSum0 = _mm256_setzero_pd();
+	__m256d vSum1 = _mm256_setzero_pd();
+	uint32_t i = 0;
+
+	for (; i + 8 <= c; i += 8)
+	{
+		vSum0 = _mm256_add_pd(vSum0, _mm256_mul_pd(_mm256_loadu_pd(&aA[i]), _mm256_loadu_pd(&aB[i])));
+		vSum1 = _mm256_add_pd(vSum1, _mm256_mul_pd(_mm256_loadu_pd(&aA[i + 4]), _mm256_loadu_pd(&aB[i + 4])));
+	}
+
+	return hsumAvx2(_mm256_add_pd(vSum0, vSum1)) + dotScalar(&aA[i], &aB[i], c - i);
+}
+
+F64_TARGET_AVX2 static double minAvx2(const double * aA, uint32_t c)
+{
+	__m256d vMin = _mm256_set1_pd(INFINITY);
+	uint32_t i = 0;
+
+	for (; i + 4 <= c; i += 4)
+	{
+		vMin = _mm256_min_pd(_mm256_loadu_pd(&aA[i]), vMin);
+	}
+
+	__m128d v2 = _mm_min_pd(_mm256_castpd256_pd128(vMin), _mm256_extractf128_pd(vMin, 1));
+	v2 = _mm_min_sd(_mm_unpackhi_pd(v2, v2), v2);
+	double mTail = minScalar(&aA[i], c - i);
+	double m = _mm_cvtsd_f64(v2);
+
+	return (mTail < m) ? mTail : m;
+}
+
+F64_TARGET_AVX2 static double maxAvx2(const double * aA, uint32_t c)
+{
+	__m256d vMax = _mm256_set1_pd(-INFINITY);
+	uint32_t i = 0;
+
+	for (; i + 4 <= c; i += 4)
+	{
+		vMax = _mm256_max_pd(_mm256_loadu_pd(&aA[i]), vMax);
+	}
+
+	__m128d v2 = _mm_max_pd(_mm256_castpd256_pd128(vMax), _mm256_extractf128_pd(vMax, 1));
+	v2 = _mm_max_sd(_mm_unpackhi_pd(v2, v2), v2);
+	double mTail = maxScalar(&aA[i], c - i);
+	double m = _mm_cvtsd_f64(v2);
+
+	return (mTail > m) ? mTail : m;
+}
+
+static const F64Kernels s_f64kAvx2 =
+{
+	"avx2",
+	addAvx2,
+	mulAvx2,
+	axpyAvx2,
+	scaleAvx2,
+	fillAvx2,
+	prefixSumAvx2,
+	sumAvx2,
+	dotAvx2,
+	minAvx2,
+	maxAvx2,
+};
+
+static bool cpuHasAvx2(void)
+{
+#if TARGET_WINDOWS
+	// AVX2 needs the CPUID feature bit and the OS saving YMM registers on context switches
+
+	int aInfo[4];
+	__cpuid(aInfo, 0);
+
+	if (aInfo[0] < 7)
+		return false;
+
+	__cpuid(aInfo, 1);
+
+	bool fOsxsave = (aInfo[2] & (1 << 27)) != 0;
+	bool fAvx = (aInfo[2] & (1 << 28)) != 0;
+
+	if (!fOsxsave || !fAvx || (_xgetbv(0) & 0x6) != 0x6)
+		return false;
+
+	__cpuidex(aInfo, 7, 0);
+
+	return (aInfo[1] & (1 << 5)) != 0;
+#else
+	// Checks CPUID and the OS's YMM support, same as above
+
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // F64_AVX2
+
+
+
+const F64Kernels * getF64Kernels(void)
+{
+	// Racing threads would all pick the same kernels, so this isn't locked
+
+	static const F64Kernels * s_pF64k = NULL;
+
+	if (UNLIKELY(s_pF64k == NULL))
+	{
+		const F64Kernels * pF64k = &s_f64kScalar;
+
+#if F64_SSE2
+		pF64k = &s_f64kSse2;
+#endif
+
+#if F64_AVX2
+		if (cpuHasAvx2())
+		{
+			pF64k = &s_f64kAvx2;
+		}
+#endif
+
+		s_pF64k = pF64k;
+	}
+
+	return s_pF64k;
+}
@@ -0,0 +1,155 @@
+//
+//  hash.c
+//  clox
+//
+
+#include "hash.h"
+
+#include <time.h>
+
+#if TARGET_WINDOWS
+#include <intrin.h>
+#endif
+
+
+
+static const uint64_t s_aSecret[4] =
+{
+	0xa0761d6478bd642full,
+	0xe7037ed1a0b428dbull,
+	0x8ebc6af09c88c6e3ull,
+	0x589965cc75374cc3ull,
+};
+
+static uint64_t s_seed = HASH_SEED;
+
+static inline void multiply128(uint64_t * pA, uint64_t * pB)
+{
+	// Full 64x64 -> 128 bit product, low half in *pA and high half in *pB
+
+#if defined(__SIZEOF_INT128__)
+	__uint128_t r = (__uint128_t)*pA * *pB;
+	*pA = (uint64_t)r;
+	*pB = (uint64_t)(r >> 64);
+#elif TARGET_WINDOWS && defined(_M_X64)
+	*pA = _umul128(*pA, *pB, pB);
+#else
+	uint64_t ha = *pA >> 32, hb = *pB >> 32, la = (uint32_t)*pA, lb = (uint32_t)*pB;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32);
+	uint64_t c = t < rl;
+	uint64_t lo = t + (rm1 << 32);
+	c += lo < t;
+	*pA = lo;
+	*pB = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t mix(uint64_t a, uint64_t b)
+{
+	multiply128(&a, &b);
+	return a ^ b;
+}
+
+static inline uint64_t read64(const uint8_t * p)
+{
+	uint64_t n;
+	memcpy(&n, p, sizeof(n));
+	return n;
+}
+
+static inline uint64_t read32(const uint8_t * p)
+{
+	uint32_t n;
+	memcpy(&n, p, sizeof(n));
+	return n;
+}
+
+void initHashSeed(void)
+{
+#if HASH_SEED_RANDOM
+	// Nothing here needs to be cryptographically strong, just different per process. Stack and
+	//  code addresses pick up ASLR, the clocks pick up when the process started.
+
+	int local;
+	uint64_t entropy = (uint64_t)time(NULL);
+	entropy = mix(entropy ^ s_aSecret[0], (uint64_t)clock() ^ s_aSecret[1]);
+	entropy = mix(entropy ^ (uint64_t)(uintptr_t)&local, s_aSecret[2]);
+	entropy = mix(entropy ^ (uint64_t)(uintptr_t)&initHashSeed, s_aSecret[3]);
+
+	s_seed = entropy;
+#endif
+}
+
+uint32_t hashString(const char * key, int length)
+{
+	ASSERT(length >= 0);
+
+	const uint8_t * p = (const uint8_t *)key;
+	size_t cB = (size_t)length;
+	uint64_t seed = s_seed ^ mix(s_seed ^ s_aSecret[0], s_aSecret[1]);
+	uint64_t a;
+	uint64_t b;
+
+	if (cB <= 16)
+	{
+		if (cB >= 4)
+		{
+			// Two overlapping reads from each end cover every byte
+
+			size_t offset = (cB >> 3) << 2;
+			a = (read32(p) << 32) | read32(p + offset);
+			b = (read32(p + cB - 4) << 32) | read32(p + cB - 4 - offset);
+		}
+		else if (cB > 0)
+		{
+			a = ((uint64_t)p[0] << 16) | ((uint64_t)p[cB >> 1] << 8) | p[cB - 1];
+			b = 0;
+		}
+		else
+		{
+			a = 0;
+			b = 0;
+		}
+	}
+	else
+	{
+		size_t i = cB;
+
+		if (i > 48)
+		{
+			// Three independent lanes so the multiplies overlap
+
+			uint64_t seed1 = seed;
+			uint64_t seed2 = seed;
+
+			do
+			{
+				seed = mix(read64(p) ^ s_aSecret[1], read64(p + 8) ^ seed);
+				seed1 = mix(read64(p + 16) ^ s_aSecret[2], read64(p + 24) ^ seed1);
+				seed2 = mix(read64(p + 32) ^ s_aSecret[3], read64(p + 40) ^ seed2);
+				p += 48;
+				i -= 48;
+			}
+			while (i > 48);
+
+			seed ^= seed1 ^ seed2;
+		}
+
+		while (i > 16)
+		{
+			seed = mix(read64(p) ^ s_aSecret[1], read64(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+
+		a = read64(p + i - 16);
+		b = read64(p + i - 8);
+	}
+
+	a ^= s_aSecret[1];
+	b ^= seed;
+	multiply128(&a, &b);
+
+	return (uint32_t)mix(a ^ s_aSecret[0] ^ cB, b ^ s_aSecret[1]);
+}
@@ -0,0 +1,773 @@
+//
+//  json.c
+//  clox
+//
+
+#include "json.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "array.h"
+#include "hash.h"
+#include "memory.h"
+#include "number.h"
+#include "object.h"
+#include "vm.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JSON_SSE2 1
+#include <emmintrin.h>
+#else
+#define JSON_SSE2 0
+#endif
+
+#if TARGET_WINDOWS
+#include <intrin.h>
+#endif
+
+
+
+// Recently seen object keys, by the low bits of their hash. Arrays of records repeat the same
+//  few keys, so most of them skip the probe into vm.strings.
+
+#define JSON_KEY_CACHE_SIZE 64
+
+typedef struct JsonParser
+{
+	const char * aCh;
+	const char * pCh;
+	const char * pChEnd;
+	int depth;
+
+	char * aryChEscaped;	// Strings with escapes are decoded into this
+
+	ObjString * apStrKey[JSON_KEY_CACHE_SIZE];
+
+	char * aChErr;
+	int cChErrMax;
+} JsonParser; // tag = jsonp
+
+static bool parseValue(JsonParser * jsonp);
+
+static bool parseError(JsonParser * jsonp, const char * message)
+{
+	snprintf(jsonp->aChErr, jsonp->cChErrMax, "Invalid JSON at offset %d: %s", (int)(jsonp->pCh - jsonp->aCh), message);
+	return false;
+}
+
+static inline void skipWhitespace(JsonParser * jsonp)
+{
+	while (jsonp->pCh < jsonp->pChEnd)
+	{
+		char ch = *jsonp->pCh;
+
+		if (ch != ' ' && ch != '\n' && ch != '\r' && ch != '\t')
+			break;
+
+		jsonp->pCh++;
+	}
+}
+
+static inline bool isStringSpecial(char ch)
+{
+	return ch == '"' || ch == '\\' || (unsigned char)ch < 0x20;
+}
+
+static inline int lowestBit(uint32_t mask)
+{
+	ASSERT(mask != 0);
+
+#if TARGET_WINDOWS
+	unsigned long iBit;
+	_BitScanForward(&iBit, mask);
+	return (int)iBit;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+static const char * scanStringChars(const char * pCh, const char * pChEnd)
+{
+	// First quote, backslash or control character at or after pCh. Plain characters make up
+	//  nearly all of a string, so they're skipped 16 at a time.
+
+#if JSON_SSE2
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i controlMax = _mm_set1_epi8(0x1F);
+
+	while (pChEnd - pCh >= 16)
+	{
+		__m128i chunk = _mm_loadu_si128((const __m128i *)pCh);
+
+		// Unsigned ch <= 0x1F is max(ch, 0x1F) == 0x1F
+
+		__m128i special = _mm_or_si128(
+							_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+							_mm_cmpeq_epi8(_mm_max_epu8(chunk, controlMax), controlMax));
+
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(special);
+
+		if (mask != 0)
+			return pCh + lowestBit(mask);
+
+		pCh += 16;
+	}
+#endif // #if JSON_SSE2
+
+	while (pCh < pChEnd && !isStringSpecial(*pCh))
+	{
+		pCh++;
+	}
+
+	return pCh;
+}
+
+static int parseHex4(const char * pCh)
+{
+	// -1 if any of the 4 characters isn't a hex digit
+
+	int n = 0;
+
+	for (int i = 0; i < 4; ++i)
+	{
+		char ch = pCh[i];
+		int digit;
+
+		if (ch >= '0' && ch <= '9')			digit = ch - '0';
+		else if (ch >= 'a' && ch <= 'f')	digit = ch - 'a' + 10;
+		else if (ch >= 'A' && ch <= 'F')	digit = ch - 'A' + 10;
+		else return -1;
+
+		n = (n << 4) | digit;
+	}
+
+	return n;
+}
+
+static void appendUtf8(char ** paryCh, uint32_t codepoint)
+{
+	char aCh[4];
+	int cCh;
+
+	if (codepoint < 0x80)
+	{
+		aCh[0] = (char)codepoint;
+		cCh = 1;
+	}
+	else if (codepoint < 0x800)
+	{
+		aCh[0] = (char)(0xC0 | (codepoint >> 6));
+		aCh[1] = (char)(0x80 | (codepoint & 0x3F));
+		cCh = 2;
+	}
+	else if (codepoint < 0x10000)
+	{
+		aCh[0] = (char)(0xE0 | (codepoint >> 12));
+		aCh[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+		aCh[2] = (char)(0x80 | (codepoint & 0x3F));
+		cCh = 3;
+	}
+	else
+	{
+		aCh[0] = (char)(0xF0 | (codepoint >> 18));
+		aCh[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+		aCh[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+		aCh[3] = (char)(0x80 | (codepoint & 0x3F));
+		cCh = 4;
+	}
+
+	ARY_APPEND(*paryCh, aCh, cCh);
+}
+
+static bool parseEscape(JsonParser * jsonp)
+{
+	// jsonp->pCh is just past the backslash
+
+	if (jsonp->pCh >= jsonp->pChEnd)
+		return parseError(jsonp, "unterminated string");
+
+	char ch = *jsonp->pCh++;
+	char chDecoded;
+
+	switch (ch)
+	{
+		case '"':	chDecoded = '"'; break;
+		case '\\':	chDecoded = '\\'; break;
+		case '/':	chDecoded = '/'; break;
+		case 'b':	chDecoded = '\b'; break;
+		case 'f':	chDecoded = '\f'; break;
+		case 'n':	chDecoded = '\n'; break;
+		case 'r':	chDecoded = '\r'; break;
+		case 't':	chDecoded = '\t'; break;
+
+		case 'u':
+		{
+			int codepoint = (jsonp->pChEnd - jsonp->pCh >= 4) ? parseHex4(jsonp->pCh) : -1;
+
+			if (codepoint < 0)
+				return parseError(jsonp, "bad \\u escape");
+
+			jsonp->pCh += 4;
+
+			// Surrogate pairs combine, a surrogate on its own is kept as is
+
+			if (codepoint >= 0xD800 && codepoint <= 0xDBFF &&
+				jsonp->pChEnd - jsonp->pCh >= 6 && jsonp->pCh[0] == '\\' && jsonp->pCh[1] == 'u')
+			{
+				int low = parseHex4(jsonp->pCh + 2);
+
+				if (low >= 0xDC00 && low <= 0xDFFF)
+				{
+					codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+					jsonp->pCh += 6;
+				}
+			}
+
+			appendUtf8(&jsonp->aryChEscaped, (uint32_t)codepoint);
+			return true;
+		}
+
+		default:
+			jsonp->pCh--;
+			return parseError(jsonp, "bad escape");
+	}
+
+	ARY_PUSH(jsonp->aryChEscaped, chDecoded);
+	return true;
+}
+
+static bool scanString(JsonParser * jsonp, const char ** ppCh, int * pCCh)
+{
+	// jsonp->pCh is just past the opening quote. Strings without escapes point straight into
+	//  the input, the rest are decoded into aryChEscaped.
+
+	const char * pChStart = jsonp->pCh;
+	const char * pCh = scanStringChars(pChStart, jsonp->pChEnd);
+
+	if (pCh < jsonp->pChEnd && *pCh == '"')
+	{
+		*ppCh = pChStart;
+		*pCCh = (int)(pCh - pChStart);
+		jsonp->pCh = pCh + 1;
+		return true;
+	}
+
+	ARY_CLEAR(jsonp->aryChEscaped);
+
+	for (;;)
+	{
+		ARY_APPEND(jsonp->aryChEscaped, pChStart, (uint32_t)(pCh - pChStart));
+		jsonp->pCh = pCh;
+
+		if (pCh >= jsonp->pChEnd)
+			return parseError(jsonp, "unterminated string");
+
+		if (*pCh == '"')
+			break;
+
+		if (*pCh != '\\')
+			return parseError(jsonp, "control character in string");
+
+		jsonp->pCh++;
+
+		if (!parseEscape(jsonp))
+			return false;
+
+		pChStart = jsonp->pCh;
+		pCh = scanStringChars(pChStart, jsonp->pChEnd);
+	}
+
+	*ppCh = jsonp->aryChEscaped;
+	*pCCh = (int)ARY_LEN(jsonp->aryChEscaped);
+	jsonp->pCh++;
+	return true;
+}
+
+static ObjString * internKey(JsonParser * jsonp, const char * pCh, int cCh)
+{
+	uint32_t hash = hashString(pCh, cCh);
+	ObjString ** ppStr = &jsonp->apStrKey[hash & (JSON_KEY_CACHE_SIZE - 1)];
+
+	// Cached keys are all in maps that hang off the result, so they can't have been collected
+
+	if (*ppStr != NULL && (*ppStr)->length == cCh && memcmp((*ppStr)->aChars, pCh, cCh) == 0)
+		return *ppStr;
+
+	*ppStr = copyStringWithHash(pCh, cCh, hash);
+	return *ppStr;
+}
+
+static bool parseNumberValue(JsonParser * jsonp)
+{
+	// Checks the grammar, -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?, then leaves the
+	//  conversion to parseNumber
+
+	const char * pChStart = jsonp->pCh;
+	const char * pCh = pChStart;
+	const char * pChEnd = jsonp->pChEnd;
+
+#define IS_DIGIT_AT(_pCh) ((_pCh) < pChEnd && *(_pCh) >= '0' && *(_pCh) <= '9')
+
+	if (pCh < pChEnd && *pCh == '-') pCh++;
+
+	if (!IS_DIGIT_AT(pCh))
+		return parseError(jsonp, "bad number");
+
+	if (*pCh == '0')
+	{
+		pCh++;
+	}
+	else
+	{
+		while (IS_DIGIT_AT(pCh)) pCh++;
+	}
+
+	bool isInteger = true;
+
+	if (pCh < pChEnd && *pCh == '.')
+	{
+		pCh++;
+		isInteger = false;
+
+		if (!IS_DIGIT_AT(pCh))
+			return parseError(jsonp, "bad number");
+
+		while (IS_DIGIT_AT(pCh)) pCh++;
+	}
+
+	if (pCh < pChEnd && (*pCh == 'e' || *pCh == 'E'))
+	{
+		pCh++;
+		isInteger = false;
+
+		if (pCh < pChEnd && (*pCh == '+' || *pCh == '-')) pCh++;
+
+		if (!IS_DIGIT_AT(pCh))
+			return parseError(jsonp, "bad number");
+
+		while (IS_DIGIT_AT(pCh)) pCh++;
+	}
+
+#undef IS_DIGIT_AT
+
+	int cCh = (int)(pCh - pChStart);
+	double num = (isInteger && *pChStart != '-') ? parseInteger(pChStart, cCh) : parseNumber(pChStart, cCh);
+
+	jsonp->pCh = pCh;
+	push(NUMBER_VAL_NARROW(num));
+	return true;
+}
+
+static bool parseLiteral(JsonParser * jsonp, const char * sz, int cCh, Value value)
+{
+	if (jsonp->pChEnd - jsonp->pCh < cCh || memcmp(jsonp->pCh, sz, cCh) != 0)
+		return parseError(jsonp, "unexpected character");
+
+	jsonp->pCh += cCh;
+	push(value);
+	return true;
+}
+
+static bool enterContainer(JsonParser * jsonp)
+{
+	// Each level keeps at most its container, a key and a value on the VM stack
+
+	if (jsonp->depth >= JSON_DEPTH_MAX || vm.stackTop + 3 > vm.stack + STACK_MAX)
+		return parseError(jsonp, "nested too deeply");
+
+	jsonp->depth++;
+	jsonp->pCh++;
+	skipWhitespace(jsonp);
+	return true;
+}
+
+static bool parseArray(JsonParser * jsonp)
+{
+	if (!enterContainer(jsonp))
+		return false;
+
+	ObjList * list = newList();
+	push(OBJ_VAL(list));
+
+	if (jsonp->pCh < jsonp->pChEnd && *jsonp->pCh == ']')
+	{
+		jsonp->pCh++;
+		jsonp->depth--;
+		return true;
+	}
+
+	for (;;)
+	{
+		if (!parseValue(jsonp))
+			return false;
+
+		ARY_PUSH(list->aryValue, vm.stackTop[-1]);
+		pop();
+
+		skipWhitespace(jsonp);
+
+		if (jsonp->pCh >= jsonp->pChEnd)
+			return parseError(jsonp, "unterminated array");
+
+		char ch = *jsonp->pCh++;
+
+		if (ch == ']')
+			break;
+
+		if (ch != ',')
+		{
+			jsonp->pCh--;
+			return parseError(jsonp, "expected ',' or ']'");
+		}
+	}
+
+	jsonp->depth--;
+	return true;
+}
+
+static bool parseObject(JsonParser * jsonp)
+{
+	if (!enterContainer(jsonp))
+		return false;
+
+	ObjMap * map = newMap();
+	push(OBJ_VAL(map));
+
+	if (jsonp->pCh < jsonp->pChEnd && *jsonp->pCh == '}')
+	{
+		jsonp->pCh++;
+		jsonp->depth--;
+		return true;
+	}
+
+	for (;;)
+	{
+		skipWhitespace(jsonp);
+
+		if (jsonp->pCh >= jsonp->pChEnd || *jsonp->pCh != '"')
+			return parseError(jsonp, "expected a string key");
+
+		jsonp->pCh++;
+
+		const char * pChKey;
+		int cChKey;
+
+		if (!scanString(jsonp, &pChKey, &cChKey))
+			return false;
+
+		push(OBJ_VAL(internKey(jsonp, pChKey, cChKey)));
+
+		skipWhitespace(jsonp);
+
+		if (jsonp->pCh >= jsonp->pChEnd || *jsonp->pCh != ':')
+			return parseError(jsonp, "expected ':'");
+
+		jsonp->pCh++;
+
+		if (!parseValue(jsonp))
+			return false;
+
+		valueTableSet(&map->table, vm.stackTop[-2], vm.stackTop[-1]);
+		pop();
+		pop();
+
+		skipWhitespace(jsonp);
+
+		if (jsonp->pCh >= jsonp->pChEnd)
+			return parseError(jsonp, "unterminated object");
+
+		char ch = *jsonp->pCh++;
+
+		if (ch == '}')
+			break;
+
+		if (ch != ',')
+		{
+			jsonp->pCh--;
+			return parseError(jsonp, "expected ',' or '}'");
+		}
+	}
+
+	jsonp->depth--;
+	return true;
+}
+
+static bool parseValue(JsonParser * jsonp)
+{
+	// Pushes the value onto the VM stack
+
+	skipWhitespace(jsonp);
+
+	if (jsonp->pCh >= jsonp->pChEnd)
+		return parseError(jsonp, "unexpected end");
+
+	switch (*jsonp->pCh)
+	{
+		case '{': return parseObject(jsonp);
+		case '[': return parseArray(jsonp);
+
+		case '"':
+		{
+			jsonp->pCh++;
+
+			const char * pCh;
+			int cCh;
+
+			if (!scanString(jsonp, &pCh, &cCh))
+				return false;
+
+			push(OBJ_VAL(copyStringTransient(pCh, cCh)));
+			return true;
+		}
+
+		case 't': return parseLiteral(jsonp, "true", 4, BOOL_VAL(true));
+		case 'f': return parseLiteral(jsonp, "false", 5, BOOL_VAL(false));
+		case 'n': return parseLiteral(jsonp, "null", 4, NIL_VAL);
+
+		default:
+		{
+			if (*jsonp->pCh == '-' || (*jsonp->pCh >= '0' && *jsonp->pCh <= '9'))
+				return parseNumberValue(jsonp);
+
+			return parseError(jsonp, "unexpected character");
+		}
+	}
+}
+
+bool parseJson(const char * aCh, int cCh, char * aChErr, int cChErrMax)
+{
+	JsonParser jsonp;
+	jsonp.aCh = aCh;
+	jsonp.pCh = aCh;
+	jsonp.pChEnd = aCh + cCh;
+	jsonp.depth = 0;
+	jsonp.aryChEscaped = NULL;
+	memset(jsonp.apStrKey, 0, sizeof(jsonp.apStrKey));
+	jsonp.aChErr = aChErr;
+	jsonp.cChErrMax = cChErrMax;
+
+	Value * stackTop = vm.stackTop;
+
+	bool fOk = parseValue(&jsonp);
+
+	if (fOk)
+	{
+		skipWhitespace(&jsonp);
+
+		if (jsonp.pCh < jsonp.pChEnd)
+		{
+			fOk = parseError(&jsonp, "unexpected text after the value");
+		}
+	}
+
+	ARY_FREE(jsonp.aryChEscaped);
+
+	// Containers that were still open are dropped on failure
+
+	vm.stackTop = (fOk) ? stackTop + 1 : stackTop;
+	return fOk;
+}
+
+static void writeString(char ** paryCh, const ObjString * str)
+{
+	static const char s_aChHex[] = "0123456789abcdef";
+
+	const char * pCh = str->aChars;
+	const char * pChEnd = pCh + str->length;
+
+	ARY_PUSH(*paryCh, '"');
+
+	for (;;)
+	{
+		// Plain runs are copied in one go, the same scan the parser uses finds where they end
+
+		const char * pChSpecial = scanStringChars(pCh, pChEnd);
+		ARY_APPEND(*paryCh, pCh, (uint32_t)(pChSpecial - pCh));
+
+		if (pChSpecial >= pChEnd)
+			break;
+
+		char ch = *pChSpecial;
+		char aChEscape[6] = { '\\', ch };
+		int cChEscape = 2;
+
+		switch (ch)
+		{
+			case '"':
+			case '\\':
+				break;
+
+			case '\b': aChEscape[1] = 'b'; break;
+			case '\f': aChEscape[1] = 'f'; break;
+			case '\n': aChEscape[1] = 'n'; break;
+			case '\r': aChEscape[1] = 'r'; break;
+			case '\t': aChEscape[1] = 't'; break;
+
+			default:
+				aChEscape[1] = 'u';
+				aChEscape[2] = '0';
+				aChEscape[3] = '0';
+				aChEscape[4] = s_aChHex[(ch >> 4) & 0xF];
+				aChEscape[5] = s_aChHex[ch & 0xF];
+				cChEscape = 6;
+				break;
+		}
+
+		ARY_APPEND(*paryCh, aChEscape, cChEscape);
+		pCh = pChSpecial + 1;
+	}
+
+	ARY_PUSH(*paryCh, '"');
+}
+
+// A map entry to be written, see writeValue
+
+typedef struct JsonMember
+{
+	ObjString * key;
+	int iSlot;
+} JsonMember; // tag = jsonm
+
+static int compareMembers(const void * pA, const void * pB)
+{
+	// Bytewise, which for UTF-8 is the same as by code point
+
+	const ObjString * strA = ((const JsonMember *)pA)->key;
+	const ObjString * strB = ((const JsonMember *)pB)->key;
+
+	int cmp = memcmp(strA->aChars, strB->aChars, MIN(strA->length, strB->length));
+
+	if (cmp != 0)
+		return cmp;
+
+	return (strA->length > strB->length) - (strA->length < strB->length);
+}
+
+static const char * writeValue(Value value, char ** paryCh, int depth)
+{
+	if (depth > JSON_DEPTH_MAX)
+		return "Can't convert to JSON, nested too deeply (or contains itself)";
+
+	if (IS_NIL(value))
+	{
+		ARY_APPEND(*paryCh, "null", 4);
+	}
+	else if (IS_BOOL(value))
+	{
+		if (AS_BOOL(value))
+		{
+			ARY_APPEND(*paryCh, "true", 4);
+		}
+		else
+		{
+			ARY_APPEND(*paryCh, "false", 5);
+		}
+	}
+	else if (IS_NUMBER(value))
+	{
+		double num = AS_NUMBER(value);
+
+		if (num - num != 0.0)
+		{
+			// NaN and infinities, same as JSON.stringify
+
+			ARY_APPEND(*paryCh, "null", 4);
+		}
+		else
+		{
+			char aCh[NUMBER_DIGITS_MAX];
+			ARY_APPEND(*paryCh, aCh, (uint32_t)formatDouble(num, aCh));
+		}
+	}
+	else if (IS_STRING(value))
+	{
+		writeString(paryCh, AS_STRING(value));
+	}
+	else if (IS_LIST(value))
+	{
+		// Elements are re-read every time, appending can run a collection
+
+		ObjList * list = AS_LIST(value);
+		ARY_PUSH(*paryCh, '[');
+
+		for (uint32_t iValue = 0; iValue < ARY_LEN(list->aryValue); ++iValue)
+		{
+			if (iValue > 0)
+			{
+				ARY_PUSH(*paryCh, ',');
+			}
+
+			const char * err = writeValue(list->aryValue[iValue], paryCh, depth + 1);
+
+			if (err != NULL)
+				return err;
+		}
+
+		ARY_PUSH(*paryCh, ']');
+	}
+	else if (IS_MAP(value))
+	{
+		// Keys are sorted, slot order depends on the hash seed and so changes from run to run.
+		//  The map holds on to the keys, and since they're all strings a collection can't clear
+		//  any entries out of a weak map, so the slots stay put while the values are written.
+
+		ValueTable * vtable = &AS_MAP(value)->table;
+		JsonMember * aryMember = NULL;
+
+		for (int iSlot = valueTableNext(vtable, 0); iSlot >= 0; iSlot = valueTableNext(vtable, iSlot + 1))
+		{
+			Value key = vtable->aKeys[iSlot];
+
+			if (!IS_STRING(key))
+			{
+				ARY_FREE(aryMember);
+				return "Can't convert to JSON, map keys must be strings";
+			}
+
+			JsonMember member = { AS_STRING(key), iSlot };
+			ARY_PUSH(aryMember, member);
+		}
+
+		if (!ARY_EMPTY(aryMember))
+		{
+			qsort(aryMember, ARY_LEN(aryMember), sizeof(JsonMember), compareMembers);
+		}
+
+		ARY_PUSH(*paryCh, '{');
+
+		for (uint32_t iMember = 0; iMember < ARY_LEN(aryMember); ++iMember)
+		{
+			if (iMember > 0)
+			{
+				ARY_PUSH(*paryCh, ',');
+			}
+
+			writeString(paryCh, aryMember[iMember].key);
+			ARY_PUSH(*paryCh, ':');
+
+			const char * err = writeValue(vtable->aValues[aryMember[iMember].iSlot], paryCh, depth + 1);
+
+			if (err != NULL)
+			{
+				ARY_FREE(aryMember);
+				return err;
+			}
+		}
+
+		ARY_PUSH(*paryCh, '}');
+		ARY_FREE(aryMember);
+	}
+	else
+	{
+		return "Can't convert to JSON, only maps, lists, strings, numbers, bools and nil can be";
+	}
+
+	return NULL;
+}
+
+const char * writeJson(Value value, char ** paryCh)
+{
+	return writeValue(value, paryCh, 0);
+}
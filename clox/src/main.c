@@ -23,11 +23,12 @@ static void repl()
 
 	for (;;)
 	{
-		printf("> ");
+		writeOutput("> ", 2);
+		flushOutput();
 
 		if (!fgets(line, sizeof(line), stdin))
 		{
-			printf("\n");
+			writeOutput("\n", 1);
 			break;
 		}
 
@@ -107,6 +108,10 @@ static void runFile(const char * path)
 	InterpretResult result = interpret(interp);
 	free(source);
 
+	// exit() skips freeVM, which would otherwise flush what the script printed
+
+	flushOutput();
+
 	switch (result)
 	{
 	case INTERPRET_COMPILE_ERROR: exit(65);
@@ -119,6 +124,13 @@ int main(int argc, const char * argv[])
 {
 	initVM();
 
+	// Someone is watching, so show each line as soon as it's printed
+
+	if (vm.output.mode == OUTPUT_FULL_BUFFERED && (argc == 1 || isOutputTerminal()))
+	{
+		setOutputMode(OUTPUT_LINE_BUFFERED);
+	}
+
 	if (argc == 1)
 	{
 		repl();
@@ -0,0 +1,249 @@
+//
+//  memo.c
+//  clox
+//
+
+#include "memo.h"
+
+#include <string.h>
+#include "memory.h"
+#include "array.h"
+
+
+
+#define MEMO_BUCKETS_MIN 16
+
+void initMemoCache(MemoCache * memoc, int arity, uint32_t cEntryMax)
+{
+	memoc->arity = arity;
+	memoc->cEntryMax = cEntryMax;
+	memoc->bucketMask = 0;
+	memoc->aiBucket = NULL;
+	memoc->aryEntry = NULL;
+	memoc->aryArg = NULL;
+	memoc->aryArgPending = NULL;
+	memoc->iNewest = -1;
+	memoc->iOldest = -1;
+}
+
+void freeMemoCache(MemoCache * memoc)
+{
+	if (memoc->aiBucket != NULL)
+	{
+		CARY_FREE(int32_t, memoc->aiBucket, memoc->bucketMask + 1);
+	}
+
+	ARY_FREE(memoc->aryEntry);
+	ARY_FREE(memoc->aryArg);
+	ARY_FREE(memoc->aryArgPending);
+	initMemoCache(memoc, memoc->arity, memoc->cEntryMax);
+}
+
+void markMemoCache(MemoCache * memoc)
+{
+	for (unsigned i = 0; i < ARY_LEN(memoc->aryEntry); i++)
+	{
+		markValue(memoc->aryEntry[i].result);
+	}
+
+	markArray(memoc->aryArg);
+	markArray(memoc->aryArgPending);
+}
+
+uint32_t hashMemoArgs(const Value * aArg, int arity)
+{
+	uint32_t hash = (uint32_t)arity;
+
+	for (int i = 0; i < arity; i++)
+	{
+		hash = (hash ^ hashValue(aArg[i])) * 0x9e3779b1u;
+	}
+
+	return hash ^ (hash >> 15);
+}
+
+static bool argsSame(const Value * aArgA, const Value * aArgB, int arity)
+{
+	for (int i = 0; i < arity; i++)
+	{
+		if (!valuesSame(aArgA[i], aArgB[i]))
+			return false;
+	}
+
+	return true;
+}
+
+static void unlinkLru(MemoCache * memoc, int32_t iEntry)
+{
+	MemoEntry * memoe = &memoc->aryEntry[iEntry];
+
+	if (memoe->iNewer >= 0)
+	{
+		memoc->aryEntry[memoe->iNewer].iOlder = memoe->iOlder;
+	}
+	else
+	{
+		memoc->iNewest = memoe->iOlder;
+	}
+
+	if (memoe->iOlder >= 0)
+	{
+		memoc->aryEntry[memoe->iOlder].iNewer = memoe->iNewer;
+	}
+	else
+	{
+		memoc->iOldest = memoe->iNewer;
+	}
+}
+
+static void linkLruNewest(MemoCache * memoc, int32_t iEntry)
+{
+	MemoEntry * memoe = &memoc->aryEntry[iEntry];
+	memoe->iNewer = -1;
+	memoe->iOlder = memoc->iNewest;
+
+	if (memoc->iNewest >= 0)
+	{
+		memoc->aryEntry[memoc->iNewest].iNewer = iEntry;
+	}
+	else
+	{
+		memoc->iOldest = iEntry;
+	}
+
+	memoc->iNewest = iEntry;
+}
+
+static void unlinkBucket(MemoCache * memoc, int32_t iEntry)
+{
+	int32_t * piEntry = &memoc->aiBucket[memoc->aryEntry[iEntry].hash & memoc->bucketMask];
+
+	while (*piEntry != iEntry)
+	{
+		ASSERT(*piEntry >= 0);
+		piEntry = &memoc->aryEntry[*piEntry].iChain;
+	}
+
+	*piEntry = memoc->aryEntry[iEntry].iChain;
+}
+
+static void linkBucket(MemoCache * memoc, int32_t iEntry)
+{
+	int32_t * piBucket = &memoc->aiBucket[memoc->aryEntry[iEntry].hash & memoc->bucketMask];
+	memoc->aryEntry[iEntry].iChain = *piBucket;
+	*piBucket = iEntry;
+}
+
+static void growBuckets(MemoCache * memoc)
+{
+	uint32_t cBucketOld = (memoc->aiBucket != NULL) ? memoc->bucketMask + 1 : 0;
+	uint32_t cBucket = (cBucketOld < MEMO_BUCKETS_MIN) ? MEMO_BUCKETS_MIN : cBucketOld * 2;
+
+	// Allocate before freeing, a collection here still sees the old buckets'
+	//  entries through aryEntry so nothing needs to be consistent yet
+
+	int32_t * aiBucket = CARY_ALLOCATE(int32_t, cBucket);
+	memset(aiBucket, 0xff, cBucket * sizeof(int32_t));
+
+	if (memoc->aiBucket != NULL)
+	{
+		CARY_FREE(int32_t, memoc->aiBucket, cBucketOld);
+	}
+
+	memoc->aiBucket = aiBucket;
+	memoc->bucketMask = cBucket - 1;
+
+	for (int32_t iEntry = 0; iEntry < (int32_t)ARY_LEN(memoc->aryEntry); iEntry++)
+	{
+		linkBucket(memoc, iEntry);
+	}
+}
+
+static int32_t findEntry(MemoCache * memoc, const Value * aArg, uint32_t hash)
+{
+	if (memoc->aiBucket == NULL)
+		return -1;
+
+	for (int32_t iEntry = memoc->aiBucket[hash & memoc->bucketMask]; iEntry >= 0; iEntry = memoc->aryEntry[iEntry].iChain)
+	{
+		if (memoc->aryEntry[iEntry].hash == hash && argsSame(&memoc->aryArg[iEntry * memoc->arity], aArg, memoc->arity))
+			return iEntry;
+	}
+
+	return -1;
+}
+
+bool memoCacheGet(MemoCache * memoc, const Value * aArg, uint32_t hash, Value * result)
+{
+	int32_t iEntry = findEntry(memoc, aArg, hash);
+	if (iEntry < 0)
+		return false;
+
+	if (memoc->cEntryMax != 0 && iEntry != memoc->iNewest)
+	{
+		unlinkLru(memoc, iEntry);
+		linkLruNewest(memoc, iEntry);
+	}
+
+	*result = memoc->aryEntry[iEntry].result;
+	return true;
+}
+
+void memoCacheSet(MemoCache * memoc, const Value * aArg, uint32_t hash, Value result)
+{
+	// A recursive call with the same arguments may have already filled this in
+
+	int32_t iEntry = findEntry(memoc, aArg, hash);
+
+	if (iEntry >= 0)
+	{
+		memoc->aryEntry[iEntry].result = result;
+		return;
+	}
+
+	int arity = memoc->arity;
+	uint32_t cEntry = ARY_LEN(memoc->aryEntry);
+
+	if (memoc->cEntryMax != 0 && cEntry >= memoc->cEntryMax)
+	{
+		// Full, reuse the least recently used entry in place
+
+		iEntry = memoc->iOldest;
+		unlinkBucket(memoc, iEntry);
+		unlinkLru(memoc, iEntry);
+	}
+	else
+	{
+		if (cEntry + 1 > memoc->bucketMask + 1 || memoc->aiBucket == NULL)
+		{
+			growBuckets(memoc);
+		}
+
+		// Arguments first, so the entry never exists without them if growing collects garbage
+
+		ARY_APPEND(memoc->aryArg, aArg, arity);
+
+		MemoEntry memoe;
+		memset(&memoe, 0, sizeof(memoe));
+		memoe.result = NIL_VAL;
+		ARY_PUSH(memoc->aryEntry, memoe);
+
+		iEntry = (int32_t)cEntry;
+	}
+
+	MemoEntry * memoe = &memoc->aryEntry[iEntry];
+	memoe->hash = hash;
+	memoe->result = result;
+
+	if (arity > 0)
+	{
+		memcpy(&memoc->aryArg[iEntry * arity], aArg, arity * sizeof(Value));
+	}
+
+	linkBucket(memoc, iEntry);
+
+	if (memoc->cEntryMax != 0)
+	{
+		linkLruNewest(memoc, iEntry);
+	}
+}
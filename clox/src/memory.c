@@ -13,6 +13,7 @@
 #include "array.h"
 #include "vm.h"
 #include "compiler.h"
+#include "thread.h"
 
 #if DEBUG_LOG_GC
 #include <stdio.h>
@@ -33,31 +34,56 @@ int64_t s_cAlloc = 0;
 
 void * xrealloc(void * previous, size_t oldSize, size_t newSize)
 {
-#if DEBUG_ALLOC
-	if (newSize > 0 && oldSize == 0)
+	int64_t dCb = newSize - oldSize;
+
+	if (UNLIKELY(vm.multithreaded))
 	{
-		s_cAlloc++;
+		// Only keep the accounting consistent while other threads are allocating
+
+#if DEBUG_ALLOC
+		if (newSize > 0 && oldSize == 0)
+		{
+			atomicAdd64(&s_cAlloc, 1);
+		}
+		else if (newSize == 0 && oldSize > 0)
+		{
+			atomicAdd64(&s_cAlloc, -1);
+		}
+#endif // DEBUG_ALLOC
+
+		CASSERT(sizeof(vm.bytesAllocated) == sizeof(int64_t));
+		atomicAdd64((volatile int64_t *)&vm.bytesAllocated, dCb);
 	}
-	else if (newSize == 0 && oldSize > 0)
+	else
 	{
-		s_cAlloc--;
-	}
+#if DEBUG_ALLOC
+		if (newSize > 0 && oldSize == 0)
+		{
+			s_cAlloc++;
+		}
+		else if (newSize == 0 && oldSize > 0)
+		{
+			s_cAlloc--;
+		}
 
-	ASSERTMSG(s_cAlloc >= 0, "Allocation count went negative!");
+		ASSERTMSG(s_cAlloc >= 0, "Allocation count went negative!");
 
-	size_t bytesAllocatedPrev = vm.bytesAllocated;
+		size_t bytesAllocatedPrev = vm.bytesAllocated;
 #endif // DEBUG_ALLOC
 
-	int64_t dCb = newSize - oldSize;
-	vm.bytesAllocated += dCb;
-	vm.bytesAllocatedMax = MAX(vm.bytesAllocated, vm.bytesAllocatedMax);
+		vm.bytesAllocated += dCb;
+		vm.bytesAllocatedMax = MAX(vm.bytesAllocated, vm.bytesAllocatedMax);
 
 #if DEBUG_ALLOC
-	ASSERTMSG(dCb >= 0 || vm.bytesAllocated < bytesAllocatedPrev, "Allocated bytes underflow!");
-	ASSERTMSG(dCb <= 0 || vm.bytesAllocated > bytesAllocatedPrev, "Allocated bytes overflow!");
+		ASSERTMSG(dCb >= 0 || vm.bytesAllocated < bytesAllocatedPrev, "Allocated bytes underflow!");
+		ASSERTMSG(dCb <= 0 || vm.bytesAllocated > bytesAllocatedPrev, "Allocated bytes overflow!");
 #endif // DEBUG_ALLOC
+	}
+
+	// Other threads write vm.bytesAllocated while multithreaded, so it can't be read here.
+	//  Collection is deferred until they're joined anyway.
 
-	if (newSize > oldSize)
+	if (newSize > oldSize && !vm.multithreaded)
 	{
 #if DEBUG_STRESS_GC
 		collectGarbage();
@@ -105,6 +131,7 @@ static void freeObject(Obj * object)
 		{
 			ObjFunction * function = (ObjFunction *)object;
 			freeChunk(&function->chunk);
+			freeLazyFunction(function->lazy);
 			FREE(ObjFunction, function);
 			break;
 		}
@@ -145,11 +172,76 @@ static void freeObject(Obj * object)
 			break;
 		}
 
+		case OBJ_MAP:
+		{
+			ObjMap * map = (ObjMap*)object;
+			freeValueTable(&map->table);
+			FREE(ObjMap, object);
+			break;
+		}
+
+		case OBJ_LIST:
+		{
+			ObjList * list = (ObjList*)object;
+			ARY_FREE(list->aryValue);
+			FREE(ObjList, object);
+			break;
+		}
+
+		case OBJ_F64ARRAY:
+		{
+			ObjF64Array * f64a = (ObjF64Array*)object;
+			CARY_FREE(double, f64a->aF64, f64a->count);
+			FREE(ObjF64Array, object);
+			break;
+		}
+
+		case OBJ_STRING_BUILDER:
+		{
+			ObjStringBuilder * sb = (ObjStringBuilder*)object;
+			ARY_FREE(sb->aryCh);
+			FREE(ObjStringBuilder, object);
+			break;
+		}
+
+		case OBJ_WEAK_REF:
+		{
+			FREE(ObjWeakRef, object);
+			break;
+		}
+
+		case OBJ_MEMO:
+		{
+			ObjMemo * memo = (ObjMemo*)object;
+			freeMemoCache(&memo->cache);
+			FREE(ObjMemo, object);
+			break;
+		}
+
 		case OBJ_STRING:
 		{
 			ObjString * string = (ObjString*)object;
-			CARY_FREE(char, (void *)string->aChars, string->length + 1);
-			FREE(ObjString, string);
+
+			switch ((StringKind)string->kind)
+			{
+				case STRING_INLINE:
+					xfree(string, sizeofStringInline(string->length));
+					break;
+
+				case STRING_OWNED:
+					CARY_FREE(char, (void *)string->aChars, string->length + 1);
+					FREE(ObjString, string);
+					break;
+
+				case STRING_SLICE:
+					FREE(ObjStringSlice, string);
+					break;
+
+				case STRING_STATIC:
+					releaseSourceBuffer(((ObjStringStatic*)string)->source);
+					FREE(ObjStringStatic, string);
+					break;
+			}
 			break;
 		}
 	}
@@ -176,6 +268,7 @@ static void markRoots(void)
 
 	markCompilerRoots();
 	markObject((Obj*)vm.initString);
+	markObject((Obj*)vm.stringClass);
 }
 
 static void blackenObject(Obj* obj)
@@ -237,8 +330,48 @@ static void blackenObject(Obj* obj)
 		markValue(((ObjUpvalue*)obj)->closed);
 		break;
 
-	case OBJ_NATIVE:
+	case OBJ_MAP:
+	{
+		ObjMap * map = (ObjMap*)obj;
+
+		if (map->isWeak)
+		{
+			ARY_PUSH(vm.aryWeakMap, map);
+		}
+		else
+		{
+			markValueTable(&map->table);
+		}
+
+		break;
+	}
+
+	case OBJ_LIST:
+		markArray(((ObjList*)obj)->aryValue);
+		break;
+
 	case OBJ_STRING:
+		if (((ObjString*)obj)->kind == STRING_SLICE)
+		{
+			markObject((Obj*)((ObjStringSlice*)obj)->parent);
+		}
+		break;
+
+	case OBJ_WEAK_REF:
+		ARY_PUSH(vm.aryWeakRef, (ObjWeakRef*)obj);
+		break;
+
+	case OBJ_MEMO:
+	{
+		ObjMemo * memo = (ObjMemo*)obj;
+		markObject((Obj*)memo->closure);
+		markMemoCache(&memo->cache);
+		break;
+	}
+
+	case OBJ_NATIVE:
+	case OBJ_F64ARRAY:
+	case OBJ_STRING_BUILDER:
 		break;
 	}
 }
@@ -253,6 +386,44 @@ static void traceReferences(void)
 	}
 }
 
+static void traceWeakReferences(void)
+{
+	// Values in weak maps are only reachable through their keys, and marking one can make another
+	//  map's key reachable, so keep going until a pass marks nothing. Maps reached during a pass
+	//  are appended and picked up by the same loop.
+
+	bool markedAny;
+
+	do
+	{
+		markedAny = false;
+
+		for (unsigned i = 0; i < ARY_LEN(vm.aryWeakMap); i++)
+		{
+			markedAny |= markValueTableEphemerons(&vm.aryWeakMap[i]->table);
+			traceReferences();
+		}
+	} while (markedAny);
+
+	for (unsigned i = 0; i < ARY_LEN(vm.aryWeakMap); i++)
+	{
+		valueTableRemoveWhite(&vm.aryWeakMap[i]->table);
+	}
+
+	for (unsigned i = 0; i < ARY_LEN(vm.aryWeakRef); i++)
+	{
+		ObjWeakRef * ref = vm.aryWeakRef[i];
+
+		if (ref->target != NULL && !getIsMarked(ref->target))
+		{
+			ref->target = NULL;
+		}
+	}
+
+	ARY_CLEAR(vm.aryWeakMap);
+	ARY_CLEAR(vm.aryWeakRef);
+}
+
 static void sweep(void)
 {
 	Obj* previous = NULL;
@@ -324,7 +495,7 @@ void markArray(Value* aryValue)
 
 void collectGarbage(void)
 {
-	if (vm.runningGC)
+	if (vm.runningGC || vm.multithreaded)
 		return;
 
 	vm.runningGC = true;
@@ -336,6 +507,7 @@ void collectGarbage(void)
 
 	markRoots();
 	traceReferences();
+	traceWeakReferences();
 	tableRemoveWhite(&vm.strings);
 	sweep();
 
@@ -0,0 +1,1014 @@
+//
+//  number.c
+//  clox
+//
+//  Formatting is Grisu2, see Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+//   Accurately with Integers" (PLDI 2010). Laid out after the version in RapidJSON.
+//
+//  Parsing is Eisel-Lemire, see Daniel Lemire, "Number Parsing at a Gigabyte per Second"
+//   (2021). Laid out after Nigel Tao's version in Go's strconv.
+//
+
+#include "number.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if TARGET_WINDOWS
+#include <intrin.h>
+#endif
+
+
+
+// A floating point number with a 64 bit significand, value = f * 2^e
+
+typedef struct DiyFp
+{
+	uint64_t f;
+	int e;
+} DiyFp; // tag = fp
+
+#define DOUBLE_SIGNIFICAND_SIZE 52
+#define DOUBLE_EXPONENT_BIAS (0x3FF + DOUBLE_SIGNIFICAND_SIZE)
+#define DOUBLE_HIDDEN_BIT 0x0010000000000000ull
+#define DOUBLE_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFull
+#define DOUBLE_EXPONENT_MASK 0x7FF0000000000000ull
+
+static const char s_aChDigitPairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+static const uint64_t s_aPow10[] =
+{
+	1ull,
+	10ull,
+	100ull,
+	1000ull,
+	10000ull,
+	100000ull,
+	1000000ull,
+	10000000ull,
+	100000000ull,
+	1000000000ull,
+	10000000000ull,
+	100000000000ull,
+	1000000000000ull,
+	10000000000000ull,
+	100000000000000ull,
+	1000000000000000ull,
+	10000000000000000ull,
+	100000000000000000ull,
+	1000000000000000000ull,
+	10000000000000000000ull,
+};
+
+// Normalized 10^k for k = -348, -340, ..., 340, rounded to nearest
+
+static const DiyFp s_aFpCachedPow10[] =
+{
+	{ 0xfa8fd5a0081c0288ull, -1220 },	// 1e-348
+	{ 0xbaaee17fa23ebf76ull, -1193 },	// 1e-340
+	{ 0x8b16fb203055ac76ull, -1166 },	// 1e-332
+	{ 0xcf42894a5dce35eaull, -1140 },	// 1e-324
+	{ 0x9a6bb0aa55653b2dull, -1113 },	// 1e-316
+	{ 0xe61acf033d1a45dfull, -1087 },	// 1e-308
+	{ 0xab70fe17c79ac6caull, -1060 },	// 1e-300
+	{ 0xff77b1fcbebcdc4full, -1034 },	// 1e-292
+	{ 0xbe5691ef416bd60cull, -1007 },	// 1e-284
+	{ 0x8dd01fad907ffc3cull, -980 },	// 1e-276
+	{ 0xd3515c2831559a83ull, -954 },	// 1e-268
+	{ 0x9d71ac8fada6c9b5ull, -927 },	// 1e-260
+	{ 0xea9c227723ee8bcbull, -901 },	// 1e-252
+	{ 0xaecc49914078536dull, -874 },	// 1e-244
+	{ 0x823c12795db6ce57ull, -847 },	// 1e-236
+	{ 0xc21094364dfb5637ull, -821 },	// 1e-228
+	{ 0x9096ea6f3848984full, -794 },	// 1e-220
+	{ 0xd77485cb25823ac7ull, -768 },	// 1e-212
+	{ 0xa086cfcd97bf97f4ull, -741 },	// 1e-204
+	{ 0xef340a98172aace5ull, -715 },	// 1e-196
+	{ 0xb23867fb2a35b28eull, -688 },	// 1e-188
+	{ 0x84c8d4dfd2c63f3bull, -661 },	// 1e-180
+	{ 0xc5dd44271ad3cdbaull, -635 },	// 1e-172
+	{ 0x936b9fcebb25c996ull, -608 },	// 1e-164
+	{ 0xdbac6c247d62a584ull, -582 },	// 1e-156
+	{ 0xa3ab66580d5fdaf6ull, -555 },	// 1e-148
+	{ 0xf3e2f893dec3f126ull, -529 },	// 1e-140
+	{ 0xb5b5ada8aaff80b8ull, -502 },	// 1e-132
+	{ 0x87625f056c7c4a8bull, -475 },	// 1e-124
+	{ 0xc9bcff6034c13053ull, -449 },	// 1e-116
+	{ 0x964e858c91ba2655ull, -422 },	// 1e-108
+	{ 0xdff9772470297ebdull, -396 },	// 1e-100
+	{ 0xa6dfbd9fb8e5b88full, -369 },	// 1e-92
+	{ 0xf8a95fcf88747d94ull, -343 },	// 1e-84
+	{ 0xb94470938fa89bcfull, -316 },	// 1e-76
+	{ 0x8a08f0f8bf0f156bull, -289 },	// 1e-68
+	{ 0xcdb02555653131b6ull, -263 },	// 1e-60
+	{ 0x993fe2c6d07b7facull, -236 },	// 1e-52
+	{ 0xe45c10c42a2b3b06ull, -210 },	// 1e-44
+	{ 0xaa242499697392d3ull, -183 },	// 1e-36
+	{ 0xfd87b5f28300ca0eull, -157 },	// 1e-28
+	{ 0xbce5086492111aebull, -130 },	// 1e-20
+	{ 0x8cbccc096f5088ccull, -103 },	// 1e-12
+	{ 0xd1b71758e219652cull, -77 },	// 1e-4
+	{ 0x9c40000000000000ull, -50 },	// 1e4
+	{ 0xe8d4a51000000000ull, -24 },	// 1e12
+	{ 0xad78ebc5ac620000ull, 3 },	// 1e20
+	{ 0x813f3978f8940984ull, 30 },	// 1e28
+	{ 0xc097ce7bc90715b3ull, 56 },	// 1e36
+	{ 0x8f7e32ce7bea5c70ull, 83 },	// 1e44
+	{ 0xd5d238a4abe98068ull, 109 },	// 1e52
+	{ 0x9f4f2726179a2245ull, 136 },	// 1e60
+	{ 0xed63a231d4c4fb27ull, 162 },	// 1e68
+	{ 0xb0de65388cc8ada8ull, 189 },	// 1e76
+	{ 0x83c7088e1aab65dbull, 216 },	// 1e84
+	{ 0xc45d1df942711d9aull, 242 },	// 1e92
+	{ 0x924d692ca61be758ull, 269 },	// 1e100
+	{ 0xda01ee641a708deaull, 295 },	// 1e108
+	{ 0xa26da3999aef774aull, 322 },	// 1e116
+	{ 0xf209787bb47d6b85ull, 348 },	// 1e124
+	{ 0xb454e4a179dd1877ull, 375 },	// 1e132
+	{ 0x865b86925b9bc5c2ull, 402 },	// 1e140
+	{ 0xc83553c5c8965d3dull, 428 },	// 1e148
+	{ 0x952ab45cfa97a0b3ull, 455 },	// 1e156
+	{ 0xde469fbd99a05fe3ull, 481 },	// 1e164
+	{ 0xa59bc234db398c25ull, 508 },	// 1e172
+	{ 0xf6c69a72a3989f5cull, 534 },	// 1e180
+	{ 0xb7dcbf5354e9beceull, 561 },	// 1e188
+	{ 0x88fcf317f22241e2ull, 588 },	// 1e196
+	{ 0xcc20ce9bd35c78a5ull, 614 },	// 1e204
+	{ 0x98165af37b2153dfull, 641 },	// 1e212
+	{ 0xe2a0b5dc971f303aull, 667 },	// 1e220
+	{ 0xa8d9d1535ce3b396ull, 694 },	// 1e228
+	{ 0xfb9b7cd9a4a7443cull, 720 },	// 1e236
+	{ 0xbb764c4ca7a44410ull, 747 },	// 1e244
+	{ 0x8bab8eefb6409c1aull, 774 },	// 1e252
+	{ 0xd01fef10a657842cull, 800 },	// 1e260
+	{ 0x9b10a4e5e9913129ull, 827 },	// 1e268
+	{ 0xe7109bfba19c0c9dull, 853 },	// 1e276
+	{ 0xac2820d9623bf429ull, 880 },	// 1e284
+	{ 0x80444b5e7aa7cf85ull, 907 },	// 1e292
+	{ 0xbf21e44003acdd2dull, 933 },	// 1e300
+	{ 0x8e679c2f5e44ff8full, 960 },	// 1e308
+	{ 0xd433179d9c8cb841ull, 986 },	// 1e316
+	{ 0x9e19db92b4e31ba9ull, 1013 },	// 1e324
+	{ 0xeb96bf6ebadf77d9ull, 1039 },	// 1e332
+	{ 0xaf87023b9bf0ee6bull, 1066 },	// 1e340
+};
+
+static inline int countLeadingZeros64(uint64_t x)
+{
+	ASSERT(x != 0);
+
+#if TARGET_WINDOWS
+	unsigned long iBit;
+	_BitScanReverse64(&iBit, x);
+	return 63 - (int)iBit;
+#else
+	return __builtin_clzll(x);
+#endif
+}
+
+static DiyFp fpFromDouble(double num)
+{
+	uint64_t bits;
+	memcpy(&bits, &num, sizeof(bits));
+
+	int biasedE = (int)((bits & DOUBLE_EXPONENT_MASK) >> DOUBLE_SIGNIFICAND_SIZE);
+	uint64_t significand = bits & DOUBLE_SIGNIFICAND_MASK;
+
+	DiyFp fp;
+
+	if (biasedE != 0)
+	{
+		fp.f = significand + DOUBLE_HIDDEN_BIT;
+		fp.e = biasedE - DOUBLE_EXPONENT_BIAS;
+	}
+	else
+	{
+		// Denormal
+
+		fp.f = significand;
+		fp.e = 1 - DOUBLE_EXPONENT_BIAS;
+	}
+
+	return fp;
+}
+
+static DiyFp fpNormalize(DiyFp fp)
+{
+	int cBitShift = countLeadingZeros64(fp.f);
+	fp.f <<= cBitShift;
+	fp.e -= cBitShift;
+	return fp;
+}
+
+static DiyFp fpMultiply(DiyFp fpA, DiyFp fpB)
+{
+	// Upper 64 bits of the 128 bit product, rounded
+
+	uint64_t a = fpA.f >> 32;
+	uint64_t b = fpA.f & 0xFFFFFFFF;
+	uint64_t c = fpB.f >> 32;
+	uint64_t d = fpB.f & 0xFFFFFFFF;
+
+	uint64_t ac = a * c;
+	uint64_t bc = b * c;
+	uint64_t ad = a * d;
+	uint64_t bd = b * d;
+
+	uint64_t mid = (bd >> 32) + (ad & 0xFFFFFFFF) + (bc & 0xFFFFFFFF);
+	mid += 1ull << 31;
+
+	DiyFp fp;
+	fp.f = ac + (ad >> 32) + (bc >> 32) + (mid >> 32);
+	fp.e = fpA.e + fpB.e + 64;
+	return fp;
+}
+
+static void normalizedBoundaries(DiyFp fp, DiyFp * pFpMinus, DiyFp * pFpPlus)
+{
+	// The halfway points to num's neighbors, anything between them reads back as num. Both
+	//  share the exponent of the normalized upper bound.
+
+	DiyFp fpPlus = { (fp.f << 1) + 1, fp.e - 1 };
+	fpPlus = fpNormalize(fpPlus);
+
+	// The gap below a power of 2 is half the gap above it
+
+	DiyFp fpMinus;
+
+	if (fp.f == DOUBLE_HIDDEN_BIT)
+	{
+		fpMinus.f = (fp.f << 2) - 1;
+		fpMinus.e = fp.e - 2;
+	}
+	else
+	{
+		fpMinus.f = (fp.f << 1) - 1;
+		fpMinus.e = fp.e - 1;
+	}
+
+	fpMinus.f <<= fpMinus.e - fpPlus.e;
+	fpMinus.e = fpPlus.e;
+
+	*pFpMinus = fpMinus;
+	*pFpPlus = fpPlus;
+}
+
+static DiyFp cachedPow10(int e, int * pK)
+{
+	// 10^-k such that e + its exponent lands in [-60, -32]
+
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int k = (int)dk;
+
+	if (dk - k > 0.0)
+	{
+		k++;
+	}
+
+	unsigned index = (unsigned)((k >> 3) + 1);
+	ASSERT(index < sizeof(s_aFpCachedPow10) / sizeof(s_aFpCachedPow10[0]));
+
+	*pK = -(-348 + (int)(index << 3));
+	return s_aFpCachedPow10[index];
+}
+
+static int countDecimalDigits32(uint32_t n)
+{
+	int cDigit = 1;
+
+	while (cDigit < 10 && n >= s_aPow10[cDigit])
+	{
+		cDigit++;
+	}
+
+	return cDigit;
+}
+
+static void roundWeed(char * aCh, int cCh, uint64_t delta, uint64_t rest, uint64_t tenKappa, uint64_t distance)
+{
+	// Step the last digit down while that gets closer to the exact value and stays in range
+
+	while (rest < distance && delta - rest >= tenKappa &&
+		   (rest + tenKappa < distance || distance - rest > rest + tenKappa - distance))
+	{
+		aCh[cCh - 1]--;
+		rest += tenKappa;
+	}
+}
+
+static int generateDigits(DiyFp fpW, DiyFp fpPlus, uint64_t delta, char * aCh, int * pK)
+{
+	DiyFp fpOne = { 1ull << -fpPlus.e, fpPlus.e };
+	uint64_t distance = fpPlus.f - fpW.f;
+
+	uint32_t p1 = (uint32_t)(fpPlus.f >> -fpOne.e);
+	uint64_t p2 = fpPlus.f & (fpOne.f - 1);
+
+	int kappa = countDecimalDigits32(p1);
+	int cCh = 0;
+
+	// Integer part
+
+	while (kappa > 0)
+	{
+		uint32_t pow10 = (uint32_t)s_aPow10[kappa - 1];
+		uint32_t digit = p1 / pow10;
+		p1 %= pow10;
+
+		if (digit != 0 || cCh != 0)
+		{
+			aCh[cCh++] = (char)('0' + digit);
+		}
+
+		kappa--;
+
+		uint64_t rest = ((uint64_t)p1 << -fpOne.e) + p2;
+
+		if (rest <= delta)
+		{
+			*pK += kappa;
+			roundWeed(aCh, cCh, delta, rest, s_aPow10[kappa] << -fpOne.e, distance);
+			return cCh;
+		}
+	}
+
+	// Fractional part
+
+	for (;;)
+	{
+		p2 *= 10;
+		delta *= 10;
+
+		char digit = (char)(p2 >> -fpOne.e);
+
+		if (digit != 0 || cCh != 0)
+		{
+			aCh[cCh++] = (char)('0' + digit);
+		}
+
+		p2 &= fpOne.f - 1;
+		kappa--;
+
+		if (p2 < delta)
+		{
+			*pK += kappa;
+			int iPow10 = -kappa;
+			roundWeed(aCh, cCh, delta, p2, fpOne.f, distance * (iPow10 < 20 ? s_aPow10[iPow10] : 0));
+			return cCh;
+		}
+	}
+}
+
+static int grisu2(double num, char * aCh, int * pK)
+{
+	// Digits of num, which is positive and finite, num = digits * 10^*pK
+
+	DiyFp fp = fpFromDouble(num);
+
+	DiyFp fpMinus;
+	DiyFp fpPlus;
+	normalizedBoundaries(fp, &fpMinus, &fpPlus);
+
+	DiyFp fpCached = cachedPow10(fpPlus.e, pK);
+
+	DiyFp fpW = fpMultiply(fpNormalize(fp), fpCached);
+	DiyFp fpWPlus = fpMultiply(fpPlus, fpCached);
+	DiyFp fpWMinus = fpMultiply(fpMinus, fpCached);
+
+	// Pull the bounds in by one unit, the multiplications were rounded
+
+	fpWMinus.f++;
+	fpWPlus.f--;
+
+	return generateDigits(fpW, fpWPlus, fpWPlus.f - fpWMinus.f, aCh, pK);
+}
+
+static int writeExponent(int exp, char * aCh)
+{
+	int cCh = 0;
+	aCh[cCh++] = 'e';
+	aCh[cCh++] = (exp < 0) ? '-' : '+';
+
+	if (exp < 0)
+	{
+		exp = -exp;
+	}
+
+	if (exp >= 100)
+	{
+		aCh[cCh++] = (char)('0' + exp / 100);
+		exp %= 100;
+		memcpy(&aCh[cCh], &s_aChDigitPairs[exp * 2], 2);
+		cCh += 2;
+	}
+	else if (exp >= 10)
+	{
+		memcpy(&aCh[cCh], &s_aChDigitPairs[exp * 2], 2);
+		cCh += 2;
+	}
+	else
+	{
+		aCh[cCh++] = (char)('0' + exp);
+	}
+
+	return cCh;
+}
+
+static int layoutDigits(char * aCh, int cDigit, int k)
+{
+	// aCh holds cDigit digits, the value is digits * 10^k. Same layout as JavaScript's
+	//  Number.prototype.toString.
+
+	int iPoint = cDigit + k;
+
+	if (cDigit <= iPoint && iPoint <= 21)
+	{
+		// 1234e7 -> 12340000000
+
+		memset(&aCh[cDigit], '0', iPoint - cDigit);
+		return iPoint;
+	}
+	else if (0 < iPoint && iPoint <= 21)
+	{
+		// 1234e-2 -> 12.34
+
+		memmove(&aCh[iPoint + 1], &aCh[iPoint], cDigit - iPoint);
+		aCh[iPoint] = '.';
+		return cDigit + 1;
+	}
+	else if (-6 < iPoint && iPoint <= 0)
+	{
+		// 1234e-6 -> 0.001234
+
+		int cZero = 2 - iPoint;
+		memmove(&aCh[cZero], aCh, cDigit);
+		aCh[0] = '0';
+		aCh[1] = '.';
+		memset(&aCh[2], '0', -iPoint);
+		return cZero + cDigit;
+	}
+	else if (cDigit == 1)
+	{
+		// 1e30 -> 1e+30
+
+		return 1 + writeExponent(iPoint - 1, &aCh[1]);
+	}
+	else
+	{
+		// 1234e30 -> 1.234e+33
+
+		memmove(&aCh[2], &aCh[1], cDigit - 1);
+		aCh[1] = '.';
+		return cDigit + 1 + writeExponent(iPoint - 1, &aCh[cDigit + 1]);
+	}
+}
+
+int formatDouble(double num, char aCh[NUMBER_DIGITS_MAX])
+{
+	if (num != num)
+	{
+		memcpy(aCh, "nan", 3);
+		return 3;
+	}
+
+	int cCh = 0;
+
+	if (num < 0)
+	{
+		aCh[cCh++] = '-';
+		num = -num;
+	}
+
+	if (num == 0)
+	{
+		// -0 prints as 0
+
+		aCh[0] = '0';
+		return 1;
+	}
+
+	if (num > 1.7976931348623157e308)
+	{
+		memcpy(&aCh[cCh], "inf", 3);
+		return cCh + 3;
+	}
+
+	// Integers below 2^53 are exact, skip straight to printing them
+
+	if (num < 9007199254740992.0 && num == (double)(int64_t)num)
+	{
+		return cCh + formatInt64((int64_t)num, &aCh[cCh]);
+	}
+
+	int k;
+	int cDigit = grisu2(num, &aCh[cCh], &k);
+	return cCh + layoutDigits(&aCh[cCh], cDigit, k);
+}
+
+int formatInt64(int64_t i, char aCh[NUMBER_DIGITS_MAX])
+{
+	// Fills a scratch buffer from the end two digits at a time, then copies it to the front
+
+	char aChTmp[24];
+	char * pCh = aChTmp + sizeof(aChTmp);
+
+	uint64_t u = (i < 0) ? 0 - (uint64_t)i : (uint64_t)i;
+
+	while (u >= 100)
+	{
+		unsigned iPair = (unsigned)(u % 100) * 2;
+		u /= 100;
+		pCh -= 2;
+		memcpy(pCh, &s_aChDigitPairs[iPair], 2);
+	}
+
+	if (u >= 10)
+	{
+		pCh -= 2;
+		memcpy(pCh, &s_aChDigitPairs[u * 2], 2);
+	}
+	else
+	{
+		*--pCh = (char)('0' + u);
+	}
+
+	if (i < 0)
+	{
+		*--pCh = '-';
+	}
+
+	int cCh = (int)(aChTmp + sizeof(aChTmp) - pCh);
+	memcpy(aCh, pCh, cCh);
+	return cCh;
+}
+
+
+
+// Powers of ten as 128 bit significands, truncated. Eisel-Lemire only needs the significand,
+//  the binary exponent comes from an approximation of log2(10^q). Covers the exponents literals
+//  without an exponent part actually hit, the rest go to strtod.
+
+typedef struct U128
+{
+	uint64_t hi;
+	uint64_t lo;
+} U128; // tag = u128
+
+#define PARSE_POW10_MIN -64
+#define PARSE_POW10_MAX 64
+
+static const U128 s_aU128Pow10[] =
+{
+	{ 0xa87fea27a539e9a5ull, 0x3f2398d747b36224ull },	// 1e-64
+	{ 0xd29fe4b18e88640eull, 0x8eec7f0d19a03aadull },	// 1e-63
+	{ 0x83a3eeeef9153e89ull, 0x1953cf68300424acull },	// 1e-62
+	{ 0xa48ceaaab75a8e2bull, 0x5fa8c3423c052dd7ull },	// 1e-61
+	{ 0xcdb02555653131b6ull, 0x3792f412cb06794dull },	// 1e-60
+	{ 0x808e17555f3ebf11ull, 0xe2bbd88bbee40bd0ull },	// 1e-59
+	{ 0xa0b19d2ab70e6ed6ull, 0x5b6aceaeae9d0ec4ull },	// 1e-58
+	{ 0xc8de047564d20a8bull, 0xf245825a5a445275ull },	// 1e-57
+	{ 0xfb158592be068d2eull, 0xeed6e2f0f0d56712ull },	// 1e-56
+	{ 0x9ced737bb6c4183dull, 0x55464dd69685606bull },	// 1e-55
+	{ 0xc428d05aa4751e4cull, 0xaa97e14c3c26b886ull },	// 1e-54
+	{ 0xf53304714d9265dfull, 0xd53dd99f4b3066a8ull },	// 1e-53
+	{ 0x993fe2c6d07b7fabull, 0xe546a8038efe4029ull },	// 1e-52
+	{ 0xbf8fdb78849a5f96ull, 0xde98520472bdd033ull },	// 1e-51
+	{ 0xef73d256a5c0f77cull, 0x963e66858f6d4440ull },	// 1e-50
+	{ 0x95a8637627989aadull, 0xdde7001379a44aa8ull },	// 1e-49
+	{ 0xbb127c53b17ec159ull, 0x5560c018580d5d52ull },	// 1e-48
+	{ 0xe9d71b689dde71afull, 0xaab8f01e6e10b4a6ull },	// 1e-47
+	{ 0x9226712162ab070dull, 0xcab3961304ca70e8ull },	// 1e-46
+	{ 0xb6b00d69bb55c8d1ull, 0x3d607b97c5fd0d22ull },	// 1e-45
+	{ 0xe45c10c42a2b3b05ull, 0x8cb89a7db77c506aull },	// 1e-44
+	{ 0x8eb98a7a9a5b04e3ull, 0x77f3608e92adb242ull },	// 1e-43
+	{ 0xb267ed1940f1c61cull, 0x55f038b237591ed3ull },	// 1e-42
+	{ 0xdf01e85f912e37a3ull, 0x6b6c46dec52f6688ull },	// 1e-41
+	{ 0x8b61313bbabce2c6ull, 0x2323ac4b3b3da015ull },	// 1e-40
+	{ 0xae397d8aa96c1b77ull, 0xabec975e0a0d081aull },	// 1e-39
+	{ 0xd9c7dced53c72255ull, 0x96e7bd358c904a21ull },	// 1e-38
+	{ 0x881cea14545c7575ull, 0x7e50d64177da2e54ull },	// 1e-37
+	{ 0xaa242499697392d2ull, 0xdde50bd1d5d0b9e9ull },	// 1e-36
+	{ 0xd4ad2dbfc3d07787ull, 0x955e4ec64b44e864ull },	// 1e-35
+	{ 0x84ec3c97da624ab4ull, 0xbd5af13bef0b113eull },	// 1e-34
+	{ 0xa6274bbdd0fadd61ull, 0xecb1ad8aeacdd58eull },	// 1e-33
+	{ 0xcfb11ead453994baull, 0x67de18eda5814af2ull },	// 1e-32
+	{ 0x81ceb32c4b43fcf4ull, 0x80eacf948770ced7ull },	// 1e-31
+	{ 0xa2425ff75e14fc31ull, 0xa1258379a94d028dull },	// 1e-30
+	{ 0xcad2f7f5359a3b3eull, 0x096ee45813a04330ull },	// 1e-29
+	{ 0xfd87b5f28300ca0dull, 0x8bca9d6e188853fcull },	// 1e-28
+	{ 0x9e74d1b791e07e48ull, 0x775ea264cf55347dull },	// 1e-27
+	{ 0xc612062576589ddaull, 0x95364afe032a819dull },	// 1e-26
+	{ 0xf79687aed3eec551ull, 0x3a83ddbd83f52204ull },	// 1e-25
+	{ 0x9abe14cd44753b52ull, 0xc4926a9672793542ull },	// 1e-24
+	{ 0xc16d9a0095928a27ull, 0x75b7053c0f178293ull },	// 1e-23
+	{ 0xf1c90080baf72cb1ull, 0x5324c68b12dd6338ull },	// 1e-22
+	{ 0x971da05074da7beeull, 0xd3f6fc16ebca5e03ull },	// 1e-21
+	{ 0xbce5086492111aeaull, 0x88f4bb1ca6bcf584ull },	// 1e-20
+	{ 0xec1e4a7db69561a5ull, 0x2b31e9e3d06c32e5ull },	// 1e-19
+	{ 0x9392ee8e921d5d07ull, 0x3aff322e62439fcfull },	// 1e-18
+	{ 0xb877aa3236a4b449ull, 0x09befeb9fad487c2ull },	// 1e-17
+	{ 0xe69594bec44de15bull, 0x4c2ebe687989a9b3ull },	// 1e-16
+	{ 0x901d7cf73ab0acd9ull, 0x0f9d37014bf60a10ull },	// 1e-15
+	{ 0xb424dc35095cd80full, 0x538484c19ef38c94ull },	// 1e-14
+	{ 0xe12e13424bb40e13ull, 0x2865a5f206b06fb9ull },	// 1e-13
+	{ 0x8cbccc096f5088cbull, 0xf93f87b7442e45d3ull },	// 1e-12
+	{ 0xafebff0bcb24aafeull, 0xf78f69a51539d748ull },	// 1e-11
+	{ 0xdbe6fecebdedd5beull, 0xb573440e5a884d1bull },	// 1e-10
+	{ 0x89705f4136b4a597ull, 0x31680a88f8953030ull },	// 1e-9
+	{ 0xabcc77118461cefcull, 0xfdc20d2b36ba7c3dull },	// 1e-8
+	{ 0xd6bf94d5e57a42bcull, 0x3d32907604691b4cull },	// 1e-7
+	{ 0x8637bd05af6c69b5ull, 0xa63f9a49c2c1b10full },	// 1e-6
+	{ 0xa7c5ac471b478423ull, 0x0fcf80dc33721d53ull },	// 1e-5
+	{ 0xd1b71758e219652bull, 0xd3c36113404ea4a8ull },	// 1e-4
+	{ 0x83126e978d4fdf3bull, 0x645a1cac083126e9ull },	// 1e-3
+	{ 0xa3d70a3d70a3d70aull, 0x3d70a3d70a3d70a3ull },	// 1e-2
+	{ 0xccccccccccccccccull, 0xccccccccccccccccull },	// 1e-1
+	{ 0x8000000000000000ull, 0x0000000000000000ull },	// 1e0
+	{ 0xa000000000000000ull, 0x0000000000000000ull },	// 1e1
+	{ 0xc800000000000000ull, 0x0000000000000000ull },	// 1e2
+	{ 0xfa00000000000000ull, 0x0000000000000000ull },	// 1e3
+	{ 0x9c40000000000000ull, 0x0000000000000000ull },	// 1e4
+	{ 0xc350000000000000ull, 0x0000000000000000ull },	// 1e5
+	{ 0xf424000000000000ull, 0x0000000000000000ull },	// 1e6
+	{ 0x9896800000000000ull, 0x0000000000000000ull },	// 1e7
+	{ 0xbebc200000000000ull, 0x0000000000000000ull },	// 1e8
+	{ 0xee6b280000000000ull, 0x0000000000000000ull },	// 1e9
+	{ 0x9502f90000000000ull, 0x0000000000000000ull },	// 1e10
+	{ 0xba43b74000000000ull, 0x0000000000000000ull },	// 1e11
+	{ 0xe8d4a51000000000ull, 0x0000000000000000ull },	// 1e12
+	{ 0x9184e72a00000000ull, 0x0000000000000000ull },	// 1e13
+	{ 0xb5e620f480000000ull, 0x0000000000000000ull },	// 1e14
+	{ 0xe35fa931a0000000ull, 0x0000000000000000ull },	// 1e15
+	{ 0x8e1bc9bf04000000ull, 0x0000000000000000ull },	// 1e16
+	{ 0xb1a2bc2ec5000000ull, 0x0000000000000000ull },	// 1e17
+	{ 0xde0b6b3a76400000ull, 0x0000000000000000ull },	// 1e18
+	{ 0x8ac7230489e80000ull, 0x0000000000000000ull },	// 1e19
+	{ 0xad78ebc5ac620000ull, 0x0000000000000000ull },	// 1e20
+	{ 0xd8d726b7177a8000ull, 0x0000000000000000ull },	// 1e21
+	{ 0x878678326eac9000ull, 0x0000000000000000ull },	// 1e22
+	{ 0xa968163f0a57b400ull, 0x0000000000000000ull },	// 1e23
+	{ 0xd3c21bcecceda100ull, 0x0000000000000000ull },	// 1e24
+	{ 0x84595161401484a0ull, 0x0000000000000000ull },	// 1e25
+	{ 0xa56fa5b99019a5c8ull, 0x0000000000000000ull },	// 1e26
+	{ 0xcecb8f27f4200f3aull, 0x0000000000000000ull },	// 1e27
+	{ 0x813f3978f8940984ull, 0x4000000000000000ull },	// 1e28
+	{ 0xa18f07d736b90be5ull, 0x5000000000000000ull },	// 1e29
+	{ 0xc9f2c9cd04674edeull, 0xa400000000000000ull },	// 1e30
+	{ 0xfc6f7c4045812296ull, 0x4d00000000000000ull },	// 1e31
+	{ 0x9dc5ada82b70b59dull, 0xf020000000000000ull },	// 1e32
+	{ 0xc5371912364ce305ull, 0x6c28000000000000ull },	// 1e33
+	{ 0xf684df56c3e01bc6ull, 0xc732000000000000ull },	// 1e34
+	{ 0x9a130b963a6c115cull, 0x3c7f400000000000ull },	// 1e35
+	{ 0xc097ce7bc90715b3ull, 0x4b9f100000000000ull },	// 1e36
+	{ 0xf0bdc21abb48db20ull, 0x1e86d40000000000ull },	// 1e37
+	{ 0x96769950b50d88f4ull, 0x1314448000000000ull },	// 1e38
+	{ 0xbc143fa4e250eb31ull, 0x17d955a000000000ull },	// 1e39
+	{ 0xeb194f8e1ae525fdull, 0x5dcfab0800000000ull },	// 1e40
+	{ 0x92efd1b8d0cf37beull, 0x5aa1cae500000000ull },	// 1e41
+	{ 0xb7abc627050305adull, 0xf14a3d9e40000000ull },	// 1e42
+	{ 0xe596b7b0c643c719ull, 0x6d9ccd05d0000000ull },	// 1e43
+	{ 0x8f7e32ce7bea5c6full, 0xe4820023a2000000ull },	// 1e44
+	{ 0xb35dbf821ae4f38bull, 0xdda2802c8a800000ull },	// 1e45
+	{ 0xe0352f62a19e306eull, 0xd50b2037ad200000ull },	// 1e46
+	{ 0x8c213d9da502de45ull, 0x4526f422cc340000ull },	// 1e47
+	{ 0xaf298d050e4395d6ull, 0x9670b12b7f410000ull },	// 1e48
+	{ 0xdaf3f04651d47b4cull, 0x3c0cdd765f114000ull },	// 1e49
+	{ 0x88d8762bf324cd0full, 0xa5880a69fb6ac800ull },	// 1e50
+	{ 0xab0e93b6efee0053ull, 0x8eea0d047a457a00ull },	// 1e51
+	{ 0xd5d238a4abe98068ull, 0x72a4904598d6d880ull },	// 1e52
+	{ 0x85a36366eb71f041ull, 0x47a6da2b7f864750ull },	// 1e53
+	{ 0xa70c3c40a64e6c51ull, 0x999090b65f67d924ull },	// 1e54
+	{ 0xd0cf4b50cfe20765ull, 0xfff4b4e3f741cf6dull },	// 1e55
+	{ 0x82818f1281ed449full, 0xbff8f10e7a8921a4ull },	// 1e56
+	{ 0xa321f2d7226895c7ull, 0xaff72d52192b6a0dull },	// 1e57
+	{ 0xcbea6f8ceb02bb39ull, 0x9bf4f8a69f764490ull },	// 1e58
+	{ 0xfee50b7025c36a08ull, 0x02f236d04753d5b4ull },	// 1e59
+	{ 0x9f4f2726179a2245ull, 0x01d762422c946590ull },	// 1e60
+	{ 0xc722f0ef9d80aad6ull, 0x424d3ad2b7b97ef5ull },	// 1e61
+	{ 0xf8ebad2b84e0d58bull, 0xd2e0898765a7deb2ull },	// 1e62
+	{ 0x9b934c3b330c8577ull, 0x63cc55f49f88eb2full },	// 1e63
+	{ 0xc2781f49ffcfa6d5ull, 0x3cbf6b71c76b25fbull },	// 1e64
+};
+
+CASSERT(sizeof(s_aU128Pow10) / sizeof(s_aU128Pow10[0]) == PARSE_POW10_MAX - PARSE_POW10_MIN + 1);
+
+static inline U128 multiply64(uint64_t a, uint64_t b)
+{
+	U128 u128;
+
+#if defined(__SIZEOF_INT128__)
+	unsigned __int128 product = (unsigned __int128)a * b;
+	u128.hi = (uint64_t)(product >> 64);
+	u128.lo = (uint64_t)product;
+#elif TARGET_WINDOWS
+	u128.lo = _umul128(a, b, &u128.hi);
+#else
+	uint64_t aHi = a >> 32;
+	uint64_t aLo = a & 0xFFFFFFFF;
+	uint64_t bHi = b >> 32;
+	uint64_t bLo = b & 0xFFFFFFFF;
+
+	uint64_t lolo = aLo * bLo;
+	uint64_t hilo = aHi * bLo;
+	uint64_t lohi = aLo * bHi;
+	uint64_t mid = (lolo >> 32) + (hilo & 0xFFFFFFFF) + lohi;
+
+	u128.hi = aHi * bHi + (hilo >> 32) + (mid >> 32);
+	u128.lo = (mid << 32) | (lolo & 0xFFFFFFFF);
+#endif
+
+	return u128;
+}
+
+static bool tryEiselLemire(uint64_t mantissa, int exp10, double * pNum)
+{
+	// mantissa * 10^exp10 correctly rounded, false in the rare cases this can't tell which way
+	//  to round
+
+	if (mantissa == 0)
+	{
+		*pNum = 0.0;
+		return true;
+	}
+
+	if (exp10 < PARSE_POW10_MIN || exp10 > PARSE_POW10_MAX)
+		return false;
+
+	const U128 * pU128Pow10 = &s_aU128Pow10[exp10 - PARSE_POW10_MIN];
+
+	int cBitShift = countLeadingZeros64(mantissa);
+	mantissa <<= cBitShift;
+
+	// 217706 / 2^16 is log2(10), close enough over this range
+
+	uint64_t exp2 = (uint64_t)(((217706 * exp10) >> 16) + 64 + 1023) - (uint64_t)cBitShift;
+
+	U128 x = multiply64(mantissa, pU128Pow10->hi);
+
+	// The power was truncated, if that could matter bring in its low 64 bits
+
+	if ((x.hi & 0x1FF) == 0x1FF && x.lo + mantissa < mantissa)
+	{
+		U128 y = multiply64(mantissa, pU128Pow10->lo);
+
+		uint64_t mergedHi = x.hi;
+		uint64_t mergedLo = x.lo + y.hi;
+
+		if (mergedLo < x.lo)
+		{
+			mergedHi++;
+		}
+
+		if ((mergedHi & 0x1FF) == 0x1FF && mergedLo + 1 == 0 && y.lo + mantissa < mantissa)
+			return false;
+
+		x.hi = mergedHi;
+		x.lo = mergedLo;
+	}
+
+	// Down to 54 bits, one more than a double holds so it can be rounded
+
+	uint64_t msb = x.hi >> 63;
+	uint64_t significand = x.hi >> (msb + 9);
+	exp2 -= 1 ^ msb;
+
+	// Exactly halfway, which way ties round depends on bits that were shifted away
+
+	if (x.lo == 0 && (x.hi & 0x1FF) == 0 && (significand & 3) == 1)
+		return false;
+
+	significand += significand & 1;
+	significand >>= 1;
+
+	if (significand >> 53)
+	{
+		significand >>= 1;
+		exp2++;
+	}
+
+	// Subnormal, infinite, or wrapped around below zero
+
+	if (exp2 - 1 >= 0x7FF - 1)
+		return false;
+
+	uint64_t bits = (exp2 << DOUBLE_SIGNIFICAND_SIZE) | (significand & DOUBLE_SIGNIFICAND_MASK);
+	memcpy(pNum, &bits, sizeof(bits));
+	return true;
+}
+
+static double parseFallback(const char * pCh, int cCh)
+{
+	// strtod is locale-sensitive, but clox never calls setlocale so it stays in
+	//  the "C" locale. It gets a terminated copy, otherwise it would read "1e5" as one number
+	//  where the scanner sees 1 followed by e5.
+
+	char aChSmall[128];
+	char * aCh = (cCh < (int)sizeof(aChSmall)) ? aChSmall : malloc(cCh + 1);
+
+	memcpy(aCh, pCh, cCh);
+	aCh[cCh] = '\0';
+
+	double num = strtod(aCh, NULL);
+
+	if (aCh != aChSmall)
+	{
+		free(aCh);
+	}
+
+	return num;
+}
+
+static const double s_aNumPow10Exact[] =
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static double parseDecimal(uint64_t mantissa, int exp10, bool isTruncated, const char * pCh, int cCh)
+{
+	// Both the mantissa and the power of ten are exact doubles, so one multiply or divide rounds
+	//  correctly (Clinger's fast path)
+
+	if (!isTruncated && mantissa <= (1ull << 53) && exp10 >= -22 && exp10 <= 22)
+	{
+		double num = (double)mantissa;
+		return (exp10 < 0) ? num / s_aNumPow10Exact[-exp10] : num * s_aNumPow10Exact[exp10];
+	}
+
+	double num;
+
+	if (!tryEiselLemire(mantissa, exp10, &num))
+		return parseFallback(pCh, cCh);
+
+	if (isTruncated)
+	{
+		// Digits past the 19th were dropped, fine as long as rounding them all up lands on the
+		//  same double
+
+		double numUp;
+
+		if (!tryEiselLemire(mantissa + 1, exp10, &numUp) || numUp != num)
+			return parseFallback(pCh, cCh);
+	}
+
+	return num;
+}
+
+double parseNumber(const char * pCh, int cCh)
+{
+	// Up to 19 significant digits fit in the mantissa, any more are dropped and made up for
+	//  in the exponent
+
+	const char * pChEnd = pCh + cCh;
+	const char * pChScan = pCh;
+
+	bool isNegative = (pChScan < pChEnd && *pChScan == '-');
+	pChScan += isNegative;
+
+	uint64_t mantissa = 0;
+	int cDigit = 0;
+	int exp10 = 0;
+	bool isTruncated = false;
+	bool isFraction = false;
+
+	for (; pChScan < pChEnd; ++pChScan)
+	{
+		char ch = *pChScan;
+
+		if (ch == '.')
+		{
+			isFraction = true;
+			continue;
+		}
+
+		if (ch == 'e' || ch == 'E')
+			break;
+
+		ASSERT(ch >= '0' && ch <= '9');
+
+		if (cDigit == 0 && ch == '0')
+		{
+			// Leading zeros aren't significant
+
+			exp10 -= isFraction;
+			continue;
+		}
+
+		if (cDigit < 19)
+		{
+			mantissa = mantissa * 10 + (uint64_t)(ch - '0');
+			cDigit++;
+			exp10 -= isFraction;
+		}
+		else
+		{
+			isTruncated |= (ch != '0');
+			exp10 += !isFraction;
+		}
+	}
+
+	if (pChScan < pChEnd)
+	{
+		// Exponent, clamped well past where every double is 0 or infinity
+
+		pChScan++;
+
+		bool isExpNegative = (*pChScan == '-');
+		pChScan += (*pChScan == '-' || *pChScan == '+');
+
+		int exp = 0;
+
+		for (; pChScan < pChEnd; ++pChScan)
+		{
+			ASSERT(*pChScan >= '0' && *pChScan <= '9');
+			exp = MIN(exp * 10 + (*pChScan - '0'), 100000);
+		}
+
+		exp10 += (isExpNegative) ? -exp : exp;
+	}
+
+	double num = parseDecimal(mantissa, exp10, isTruncated, pCh + isNegative, cCh - isNegative);
+	return (isNegative) ? -num : num;
+}
+
+int scanNumber(const char * pCh, const char * pChEnd, bool * pIsInteger)
+{
+	const char * pChScan = pCh;
+
+#define IS_DIGIT_AT(_pCh) ((_pCh) < pChEnd && *(_pCh) >= '0' && *(_pCh) <= '9')
+
+	bool isNegative = (pChScan < pChEnd && *pChScan == '-');
+	pChScan += isNegative;
+
+	if (!IS_DIGIT_AT(pChScan))
+		return 0;
+
+	if (*pChScan == '0')
+	{
+		pChScan++;
+	}
+	else
+	{
+		while (IS_DIGIT_AT(pChScan)) pChScan++;
+	}
+
+	bool isInteger = !isNegative;
+
+	if (pChScan < pChEnd && *pChScan == '.')
+	{
+		pChScan++;
+		isInteger = false;
+
+		if (!IS_DIGIT_AT(pChScan))
+			return 0;
+
+		while (IS_DIGIT_AT(pChScan)) pChScan++;
+	}
+
+	if (pChScan < pChEnd && (*pChScan == 'e' || *pChScan == 'E'))
+	{
+		pChScan++;
+		isInteger = false;
+
+		if (pChScan < pChEnd && (*pChScan == '+' || *pChScan == '-')) pChScan++;
+
+		if (!IS_DIGIT_AT(pChScan))
+			return 0;
+
+		while (IS_DIGIT_AT(pChScan)) pChScan++;
+	}
+
+#undef IS_DIGIT_AT
+
+	*pIsInteger = isInteger;
+	return (int)(pChScan - pCh);
+}
+
+double parseInteger(const char * pCh, int cCh)
+{
+	if (cCh > 19)
+		return parseNumber(pCh, cCh);
+
+	uint64_t mantissa = 0;
+
+	for (int iCh = 0; iCh < cCh; ++iCh)
+	{
+		ASSERT(pCh[iCh] >= '0' && pCh[iCh] <= '9');
+		mantissa = mantissa * 10 + (uint64_t)(pCh[iCh] - '0');
+	}
+
+	if (mantissa <= (1ull << 53))
+		return (double)mantissa;
+
+	return parseDecimal(mantissa, 0, false, pCh, cCh);
+}
@@ -13,51 +13,76 @@
 #include "memory.h"
 #include "vm.h"
 #include "array.h"
+#include "output.h"
 
 
 
 #define ALLOCATE_OBJ(type, objectType) (type*)allocateObject(sizeof(type), objectType)
 
-static Obj * allocateObject(size_t size, ObjType type)
+static void linkObject(Obj * object, ObjType type, size_t size)
 {
-	Obj * object = (Obj*)xrealloc(NULL, 0, size);
+	UNUSED(size);
+
 	initObj(object, type, vm.objects);
 	vm.objects = object;
 
 #if DEBUG_LOG_GC
 	printf("%p allocate %zd for %d\n", (void*)object, size, type);
 #endif // DEBUG_LOG_GC
+}
 
+static Obj * allocateObject(size_t size, ObjType type)
+{
+	Obj * object = (Obj*)xrealloc(NULL, 0, size);
+	linkObject(object, type, size);
 	return object;
 }
 
-static ObjString * allocateString(const char * aCh, int cCh, uint32_t hash)
+static ObjString * allocateStringInline(int length)
 {
-	ObjString * pStr = ALLOCATE_OBJ(ObjString, OBJ_STRING);
-	pStr->hash = hash;
-	pStr->length = cCh;
-	pStr->aChars = aCh;
+	// Not an object yet, callers fill in the characters and then pass it to internNewString or
+	//  linkStringTransient
 
-	push(OBJ_VAL(pStr));
-	tableSet(&vm.strings, pStr, NIL_VAL);
-	pop();
+	ObjStringInline * pStrInline = xmalloc(sizeofStringInline(length));
+	pStrInline->aChInline[length] = '\0';
+
+	ObjString * pStr = &pStrInline->str;
+	pStr->length = length;
+	pStr->aChars = pStrInline->aChInline;
+	pStr->kind = STRING_INLINE;
 
 	return pStr;
 }
 
-static uint32_t hashString(const char * key, int length)
+static ObjString * linkStringTransient(ObjString * pStr)
 {
-	// FNV-1a
+	ASSERT(pStr->kind == STRING_INLINE);
+
+	linkObject(&pStr->obj, OBJ_STRING, sizeofStringInline(pStr->length));
 
-	uint32_t hash = 2166136261u;
+	pStr->hash = 0;
+	pStr->isInterned = false;
+	pStr->isHashed = false;
 
-	for (int i = 0; i < length; ++i)
+	return pStr;
+}
+
+static ObjString * internNewString(ObjString * pStr, uint32_t hash)
+{
+	if (pStr->kind == STRING_INLINE)
 	{
-		hash ^= key[i];
-		hash *= 16777619u;
+		linkObject(&pStr->obj, OBJ_STRING, sizeofStringInline(pStr->length));
 	}
 
-	return hash;
+	pStr->hash = hash;
+	pStr->isInterned = true;
+	pStr->isHashed = true;
+
+	push(OBJ_VAL(pStr));
+	tableSet(&vm.strings, pStr, NIL_VAL);
+	pop();
+
+	return pStr;
 }
 
 ObjUpvalue* newUpvalue(Value* slot)
@@ -75,6 +100,7 @@ ObjFunction * newFunction(void)
 	function->arity = 0;
 	function->upvalueCount = 0;
 	function->name = NULL;
+	function->lazy = NULL;
 	initChunk(&function->chunk);
 
 	return function;
@@ -113,7 +139,7 @@ ObjClosure * newClosure(ObjFunction * function)
 	return closure;
 }
 
-ObjBoundMethod* newBoundMethod(Value receiver, ObjClosure* method)
+ObjBoundMethod* newBoundMethod(Value receiver, Obj * method)
 {
 	ObjBoundMethod * boundMethod = ALLOCATE_OBJ(ObjBoundMethod, OBJ_BOUND_METHOD);
 	boundMethod->receiver = receiver;
@@ -128,42 +154,99 @@ ObjNative * newNative(NativeFn function)
 	return native;
 }
 
+ObjMap * newMap(void)
+{
+	ObjMap * map = ALLOCATE_OBJ(ObjMap, OBJ_MAP);
+	initValueTable(&map->table);
+	map->isWeak = false;
+	return map;
+}
+
+ObjMap * newWeakMap(void)
+{
+	ObjMap * map = newMap();
+	map->isWeak = true;
+	return map;
+}
+
+ObjList * newList(void)
+{
+	ObjList * list = ALLOCATE_OBJ(ObjList, OBJ_LIST);
+	list->aryValue = NULL;
+	return list;
+}
+
+ObjF64Array * newF64Array(uint32_t count)
+{
+	// Elements first, so a collection can't find the unrooted object before aF64 is set
+
+	double * aF64 = xcalloc(count, sizeof(double));
+
+	ObjF64Array * f64a = ALLOCATE_OBJ(ObjF64Array, OBJ_F64ARRAY);
+	f64a->count = count;
+	f64a->aF64 = aF64;
+	return f64a;
+}
+
+ObjStringBuilder * newStringBuilder(void)
+{
+	ObjStringBuilder * sb = ALLOCATE_OBJ(ObjStringBuilder, OBJ_STRING_BUILDER);
+	sb->aryCh = NULL;
+	return sb;
+}
+
+ObjWeakRef * newWeakRef(Obj * target)
+{
+	ObjWeakRef * ref = ALLOCATE_OBJ(ObjWeakRef, OBJ_WEAK_REF);
+	ref->target = target;
+	return ref;
+}
+
+ObjMemo * newMemo(ObjClosure * closure, uint32_t cEntryMax)
+{
+	ObjMemo * memo = ALLOCATE_OBJ(ObjMemo, OBJ_MEMO);
+	memo->closure = closure;
+	initMemoCache(&memo->cache, closure->function->arity, cEntryMax);
+	return memo;
+}
+
 ObjString * concatStrings(const ObjString * pStrA, const ObjString * pStrB)
 {
 	int length = pStrA->length + pStrB->length;
-	char * aCh = CARY_ALLOCATE(char, length + 1);
+	ObjString * pStr = allocateStringInline(length);
+	char * aCh = (char *)pStr->aChars;
 
 	memcpy(aCh, pStrA->aChars, pStrA->length);
 	memcpy(aCh + pStrA->length, pStrB->aChars, pStrB->length);
-	aCh[length] = '\0';
-	
-	uint32_t hash = hashString(aCh, length);
 
-	ObjString * pStr = tableFindString(&vm.strings, aCh, length, hash);
-	if (pStr != NULL)
-	{
-		// BB (matthewp) Could probably find a way to do this without needing to allocate memory at all
+	return linkStringTransient(pStr);
+}
 
-		CARY_FREE(char, aCh, length + 1);
-		return pStr;
-	}
+ObjString * copyStringTransient(const char * chars, int length)
+{
+	ObjString * pStr = allocateStringInline(length);
+	memcpy((char *)pStr->aChars, chars, length);
 
-	return allocateString(aCh, length, hash);
+	return linkStringTransient(pStr);
 }
 
 ObjString * copyString(const char * chars, int length)
 {
-	uint32_t hash = hashString(chars, length);
+	return copyStringWithHash(chars, length, hashString(chars, length));
+}
+
+ObjString * copyStringWithHash(const char * chars, int length, uint32_t hash)
+{
+	ASSERT(hash == hashString(chars, length));
 
 	ObjString * pStr = tableFindString(&vm.strings, chars, length, hash);
 	if (pStr != NULL)
 		return pStr;
 
-	char * aCh = CARY_ALLOCATE(char, length + 1);
-	memcpy(aCh, chars, length);
-	aCh[length] = '\0';
+	pStr = allocateStringInline(length);
+	memcpy((char *)pStr->aChars, chars, length);
 
-	return allocateString(aCh, length, hash);
+	return internNewString(pStr, hash);
 }
 
 ObjString * takeString(const char * chars, int length)
@@ -177,25 +260,166 @@ ObjString * takeString(const char * chars, int length)
 		return pStr;
 	}
 
-	return allocateString(chars, length, hash);
+	// Adopts the buffer instead of copying it, so the characters stay out of line
+
+	pStr = ALLOCATE_OBJ(ObjString, OBJ_STRING);
+	pStr->length = length;
+	pStr->aChars = chars;
+	pStr->kind = STRING_OWNED;
+
+	return internNewString(pStr, hash);
+}
+
+ObjString * copyStringStatic(SourceBuffer * src, const char * chars, int length, uint32_t hash)
+{
+	ASSERT(hash == hashString(chars, length));
+	ASSERT(isInSourceBuffer(src, chars, length));
+
+	ObjString * pStr = tableFindString(&vm.strings, chars, length, hash);
+	if (pStr != NULL)
+		return pStr;
+
+	ObjStringStatic * pStrStatic = ALLOCATE_OBJ(ObjStringStatic, OBJ_STRING);
+	pStrStatic->str.length = length;
+	pStrStatic->str.aChars = chars;
+	pStrStatic->str.kind = STRING_STATIC;
+	pStrStatic->source = retainSourceBuffer(src);
+
+	return internNewString(&pStrStatic->str, hash);
+}
+
+ObjString * sliceString(ObjString * str, int start, int length)
+{
+	ASSERT(start >= 0 && length >= 0 && start + length <= str->length);
+
+	if (length == str->length)
+		return str;
+
+	if (length == 0)
+		return copyString("", 0);
+
+	if (str->kind == STRING_SLICE)
+	{
+		ObjString * parent = ((ObjStringSlice *)str)->parent;
+		start += (int)(str->aChars - parent->aChars);
+		str = parent;
+	}
+
+	ObjStringSlice * slice = ALLOCATE_OBJ(ObjStringSlice, OBJ_STRING);
+	slice->str.hash = 0;
+	slice->str.length = length;
+	slice->str.aChars = str->aChars + start;
+	slice->str.kind = STRING_SLICE;
+	slice->str.isInterned = false;
+	slice->str.isHashed = false;
+	slice->parent = str;
+
+	return &slice->str;
+}
+
+ObjString * internString(ObjString * str)
+{
+	if (str->isInterned)
+		return str;
+
+	ObjString * pStrInterned = tableFindString(&vm.strings, str->aChars, str->length, getStringHash(str));
+	if (pStrInterned != NULL)
+		return pStrInterned;
+
+	// A slice would keep its whole parent alive for as long as it stayed interned, so intern a
+	//  copy of just its characters instead. The slice itself keeps pointing into its parent.
+
+	if (str->kind == STRING_SLICE)
+	{
+		push(OBJ_VAL(str));
+		pStrInterned = copyStringWithHash(str->aChars, str->length, str->hash);
+		pop();
+
+		return pStrInterned;
+	}
+
+	// Nothing to share with yet, so this string becomes the interned one
+
+	str->isInterned = true;
+
+	push(OBJ_VAL(str));
+	tableSet(&vm.strings, str, NIL_VAL);
+	pop();
+
+	return str;
+}
+
+uint32_t getStringHash(ObjString * str)
+{
+	if (!str->isHashed)
+	{
+		str->hash = hashString(str->aChars, str->length);
+		str->isHashed = true;
+	}
+
+	return str->hash;
+}
+
+bool stringsEqual(const ObjString * strA, const ObjString * strB)
+{
+	if (strA == strB)
+		return true;
+
+	if (strA->isInterned && strB->isInterned)
+		return false;
+
+	if (strA->isHashed && strB->isHashed && strA->hash != strB->hash)
+		return false;
+
+	return strA->length == strB->length && memcmp(strA->aChars, strB->aChars, strA->length) == 0;
 }
 
 static void printFunction(ObjFunction* function)
 {
 	if (function->name == NULL)
 	{
-		printf("<script>");
+		writeOutputString("<script>");
 	}
 	else
 	{
-		printf("<fn %s>", function->name->aChars);
+		writeOutputFormat("<fn %.*s>", function->name->length, function->name->aChars);
 	}
 }
 
 static void printInstance(ObjInstance* inst)
 {
 	// TODO: Call (optional) user-supplied toString() method
-	printf("<%s instance>", inst->klass->name->aChars);
+	writeOutputFormat("<%.*s instance>", inst->klass->name->length, inst->klass->name->aChars);
+}
+
+static void printList(ObjList * list)
+{
+	// A list can contain itself, so stop descending at a fixed depth rather than
+	//  tracking which lists are already being printed
+
+	static int s_depth = 0;
+
+	if (s_depth >= 16)
+	{
+		writeOutputString("[...]");
+		return;
+	}
+
+	s_depth++;
+	writeOutputString("[");
+
+	for (uint32_t iValue = 0; iValue < ARY_LEN(list->aryValue); ++iValue)
+	{
+		if (iValue > 0)
+		{
+			writeOutputString(", ");
+		}
+
+		printValue(list->aryValue[iValue]);
+	}
+
+	writeOutputString("]");
+	s_depth--;
 }
 
 void printObject(Value value)
@@ -203,7 +427,7 @@ void printObject(Value value)
 	switch (OBJ_TYPE(value))
 	{
 		case OBJ_UPVALUE:
-			printf("<upvalue>");
+			writeOutputString("<upvalue>");
 			break;
 
 		case OBJ_FUNCTION:
@@ -211,7 +435,7 @@ void printObject(Value value)
 			break;
 
 		case OBJ_CLASS:
-			printf("<%s>", AS_CLASS(value)->name->aChars);
+			writeOutputFormat("<%.*s>", AS_CLASS(value)->name->length, AS_CLASS(value)->name->aChars);
 			break;
 
 		case OBJ_INSTANCE:
@@ -223,15 +447,53 @@ void printObject(Value value)
 			break;
 
 		case OBJ_BOUND_METHOD:
-			printFunction(AS_BOUND_METHOD(value)->method->function);
+		{
+			Obj * method = AS_BOUND_METHOD(value)->method;
+
+			if (getObjType(method) == OBJ_CLOSURE)
+			{
+				printFunction(((ObjClosure*)method)->function);
+			}
+			else
+			{
+				writeOutputString("<native method>");
+			}
 			break;
+		}
 
 		case OBJ_NATIVE:
-			printf("<native fn 0x%p>", AS_NATIVE(value));
+			writeOutputFormat("<native fn 0x%p>", AS_NATIVE(value));
 			break;
 
 		case OBJ_STRING:
-			printf("%s", AS_CSTRING(value));
+			writeOutput(AS_STRING(value)->aChars, AS_STRING(value)->length);
+			break;
+
+		case OBJ_MAP:
+			writeOutputString(AS_MAP(value)->isWeak ? "<weak map>" : "<map>");
+			break;
+
+		case OBJ_LIST:
+			printList(AS_LIST(value));
+			break;
+
+		case OBJ_F64ARRAY:
+			writeOutputFormat("<f64array %u>", AS_F64ARRAY(value)->count);
+			break;
+
+		case OBJ_STRING_BUILDER:
+			writeOutputString("<string builder>");
+			break;
+
+		case OBJ_WEAK_REF:
+			writeOutputString("<weak ref>");
+			break;
+
+		case OBJ_MEMO:
+		{
+			ObjString * name = AS_MEMO(value)->closure->function->name;
+			writeOutputFormat("<memoized fn %.*s>", name->length, name->aChars);
 			break;
+		}
 	}
 }
@@ -0,0 +1,149 @@
+//
+//  output.c
+//  clox
+//
+
+// fileno is POSIX rather than standard C, so strict C modes only declare it when asked to
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "output.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#if TARGET_WINDOWS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "vm.h"
+
+
+
+void initOutput(OutputMode mode)
+{
+	vm.output.mode = mode;
+	vm.output.cCh = 0;
+}
+
+void setOutputMode(OutputMode mode)
+{
+	flushOutput();
+	vm.output.mode = mode;
+}
+
+bool isOutputTerminal(void)
+{
+#if TARGET_WINDOWS
+	return _isatty(_fileno(stdout)) != 0;
+#else
+	return isatty(fileno(stdout)) != 0;
+#endif
+}
+
+void flushOutput(void)
+{
+	OutputBuffer * outb = &vm.output;
+
+	if (outb->cCh > 0)
+	{
+		fwrite(outb->aCh, 1, outb->cCh, stdout);
+		outb->cCh = 0;
+	}
+
+	fflush(stdout);
+}
+
+void writeOutput(const char * pCh, int cCh)
+{
+	OutputBuffer * outb = &vm.output;
+
+	if (outb->mode == OUTPUT_UNBUFFERED)
+	{
+		// Still goes through stdio so it interleaves with the debug printfs
+
+		fwrite(pCh, 1, cCh, stdout);
+		return;
+	}
+
+	if (outb->cCh + cCh > OUTPUT_BUFFER_SIZE)
+	{
+		flushOutput();
+
+		if (cCh > OUTPUT_BUFFER_SIZE)
+		{
+			fwrite(pCh, 1, cCh, stdout);
+			fflush(stdout);
+			return;
+		}
+	}
+
+	memcpy(&outb->aCh[outb->cCh], pCh, cCh);
+	outb->cCh += cCh;
+
+	if (outb->mode == OUTPUT_LINE_BUFFERED && memchr(pCh, '\n', cCh) != NULL)
+	{
+		flushOutput();
+	}
+}
+
+void writeOutputString(const char * sz)
+{
+	writeOutput(sz, (int)strlen(sz));
+}
+
+void writeOutputFormat(const char * format, ...)
+{
+	// Formats straight into the buffer, flushing first if it didn't fit
+
+	OutputBuffer * outb = &vm.output;
+	va_list args;
+
+	if (outb->mode != OUTPUT_UNBUFFERED)
+	{
+		va_start(args, format);
+		int cCh = vsnprintf(&outb->aCh[outb->cCh], OUTPUT_BUFFER_SIZE - outb->cCh, format, args);
+		va_end(args);
+
+		if (cCh >= OUTPUT_BUFFER_SIZE - outb->cCh)
+		{
+			flushOutput();
+
+			if (cCh < OUTPUT_BUFFER_SIZE)
+			{
+				va_start(args, format);
+				vsnprintf(outb->aCh, OUTPUT_BUFFER_SIZE, format, args);
+				va_end(args);
+			}
+			else
+			{
+				cCh = 0;
+				va_start(args, format);
+				vfprintf(stdout, format, args);
+				va_end(args);
+			}
+		}
+
+		if (cCh > 0)
+		{
+			const char * pCh = &outb->aCh[outb->cCh];
+			outb->cCh += cCh;
+
+			if (outb->mode == OUTPUT_LINE_BUFFERED && memchr(pCh, '\n', cCh) != NULL)
+			{
+				flushOutput();
+			}
+		}
+
+		return;
+	}
+
+	va_start(args, format);
+	vfprintf(stdout, format, args);
+	va_end(args);
+}
@@ -8,6 +8,7 @@
 
 #include "common.h"
 #include "scanner.h"
+#include "hash.h"
 
 #include <stdio.h>
 
@@ -68,6 +69,8 @@ static Token makeToken(Scanner * scanner, TokenType type)
 	token.start = scanner->start;
 	token.length = (int)(scanner->current - scanner->start);
 	token.line = scanner->line;
+	token.hash = 0;
+	token.isInteger = false;
 
 	return token;
 }
@@ -79,6 +82,8 @@ static Token errorToken(Scanner * scanner, const char* message)
 	token.start = message;
 	token.length = (int)strlen(message);
 	token.line = scanner->line;
+	token.hash = 0;
+	token.isInteger = false;
 
 	return token;
 }
@@ -169,25 +174,40 @@ static TokenType identifierType(Scanner * scanner)
 
 static Token identifier(Scanner * scanner)
 {
-	while (isAlpha(peek(scanner)) || isDigit(peek(scanner))) advance(scanner);
+	while (isAlpha(peek(scanner)) || isDigit(peek(scanner)))
+	{
+		advance(scanner);
+	}
+
+	// Hashed here while the characters are still in cache, saves the compiler from hashing every
+	//  identifier again when interning it
+
+	Token token = makeToken(scanner, identifierType(scanner));
+	if (token.type == TOKEN_IDENTIFIER) token.hash = hashString(token.start, token.length);
 
-	return makeToken(scanner, identifierType(scanner));
+	return token;
 }
 
 static Token number(Scanner * scanner)
 {
 	while (isDigit(peek(scanner))) advance(scanner);
 
+	bool isInteger = true;
+
 	// Look for a fractional part.
 	if (peek(scanner) == '.' && isDigit(peekNext(scanner)))
 	{
 		// Consume the "."
 		advance(scanner);
+		isInteger = false;
 
 		while (isDigit(peek(scanner))) advance(scanner);
 	}
 
-	return makeToken(scanner, TOKEN_NUMBER);
+	Token token = makeToken(scanner, TOKEN_NUMBER);
+	token.isInteger = isInteger;
+
+	return token;
 }
 
 static Token string(Scanner * scanner)
@@ -224,6 +244,8 @@ Token scanToken(Scanner * scanner)
 		case ')': return makeToken(scanner, TOKEN_RIGHT_PAREN);
 		case '{': return makeToken(scanner, TOKEN_LEFT_BRACE);
 		case '}': return makeToken(scanner, TOKEN_RIGHT_BRACE);
+		case '[': return makeToken(scanner, TOKEN_LEFT_BRACKET);
+		case ']': return makeToken(scanner, TOKEN_RIGHT_BRACKET);
 		case ';': return makeToken(scanner, TOKEN_SEMICOLON);
 		case ',': return makeToken(scanner, TOKEN_COMMA);
 		case '.': return makeToken(scanner, TOKEN_DOT);
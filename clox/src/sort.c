@@ -0,0 +1,153 @@
+//
+//  sort.c
+//  clox
+//
+
+#include "sort.h"
+
+
+
+// Ranges this short are left for insertion sort
+
+#define SORT_INSERTION_MAX 16
+
+static inline void swapValues(Value * a, Value * b)
+{
+	Value tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+static void insertionSort(Value * aValue, uint32_t cValue, ValueLessFn lessFn)
+{
+	for (uint32_t i = 1; i < cValue; ++i)
+	{
+		Value value = aValue[i];
+		uint32_t j = i;
+
+		while (j > 0 && lessFn(value, aValue[j - 1]))
+		{
+			aValue[j] = aValue[j - 1];
+			j--;
+		}
+
+		aValue[j] = value;
+	}
+}
+
+static void siftDown(Value * aValue, uint32_t iRoot, uint32_t cValue, ValueLessFn lessFn)
+{
+	for (;;)
+	{
+		uint32_t iChild = 2 * iRoot + 1;
+
+		if (iChild >= cValue)
+			return;
+
+		if (iChild + 1 < cValue && lessFn(aValue[iChild], aValue[iChild + 1]))
+		{
+			iChild++;
+		}
+
+		if (!lessFn(aValue[iRoot], aValue[iChild]))
+			return;
+
+		swapValues(&aValue[iRoot], &aValue[iChild]);
+		iRoot = iChild;
+	}
+}
+
+static void heapSort(Value * aValue, uint32_t cValue, ValueLessFn lessFn)
+{
+	for (uint32_t i = cValue / 2; i > 0; --i)
+	{
+		siftDown(aValue, i - 1, cValue, lessFn);
+	}
+
+	for (uint32_t i = cValue - 1; i > 0; --i)
+	{
+		swapValues(&aValue[0], &aValue[i]);
+		siftDown(aValue, 0, i, lessFn);
+	}
+}
+
+static uint32_t partition(Value * aValue, uint32_t cValue, ValueLessFn lessFn)
+{
+	// Median of three moved to the front as the pivot. The last element is then known to be no less
+	//  than the pivot, and the pivot itself stops the downward scan, so neither scan can run off the range.
+
+	uint32_t iMid = cValue / 2;
+	uint32_t iLast = cValue - 1;
+
+	if (lessFn(aValue[iMid], aValue[0]))		swapValues(&aValue[iMid], &aValue[0]);
+	if (lessFn(aValue[iLast], aValue[iMid]))	swapValues(&aValue[iLast], &aValue[iMid]);
+	if (lessFn(aValue[iMid], aValue[0]))		swapValues(&aValue[iMid], &aValue[0]);
+
+	swapValues(&aValue[0], &aValue[iMid]);
+
+	Value pivot = aValue[0];
+	uint32_t i = 0;
+	uint32_t j = cValue;
+
+	for (;;)
+	{
+		do { i++; } while (lessFn(aValue[i], pivot));
+		do { j--; } while (lessFn(pivot, aValue[j]));
+
+		if (i >= j)
+			break;
+
+		swapValues(&aValue[i], &aValue[j]);
+	}
+
+	swapValues(&aValue[0], &aValue[j]);
+	return j;
+}
+
+static void introSort(Value * aValue, uint32_t cValue, int depthLimit, ValueLessFn lessFn)
+{
+	while (cValue > SORT_INSERTION_MAX)
+	{
+		if (depthLimit == 0)
+		{
+			heapSort(aValue, cValue, lessFn);
+			return;
+		}
+
+		depthLimit--;
+
+		// Recurse on the smaller side so the stack stays O(log n)
+
+		uint32_t iPivot = partition(aValue, cValue, lessFn);
+		uint32_t cLeft = iPivot;
+		uint32_t cRight = cValue - iPivot - 1;
+
+		if (cLeft < cRight)
+		{
+			introSort(aValue, cLeft, depthLimit, lessFn);
+			aValue += iPivot + 1;
+			cValue = cRight;
+		}
+		else
+		{
+			introSort(aValue + iPivot + 1, cRight, depthLimit, lessFn);
+			cValue = cLeft;
+		}
+	}
+
+	insertionSort(aValue, cValue, lessFn);
+}
+
+void sortValues(Value * aValue, uint32_t cValue, ValueLessFn lessFn)
+{
+	if (cValue < 2)
+		return;
+
+	int depthLimit = 0;
+	for (uint32_t c = cValue; c > 1; c >>= 1)
+	{
+		depthLimit += 2;
+	}
+
+	introSort(aValue, cValue, depthLimit, lessFn);
+}
@@ -0,0 +1,47 @@
+//
+//  source.c
+//  clox
+//
+
+#include "source.h"
+
+#include <string.h>
+#include "memory.h"
+#include "thread.h"
+
+
+
+SourceBuffer * newSourceBuffer(const char * source)
+{
+	int length = (int)strlen(source);
+
+	SourceBuffer * src = xmalloc(sizeof(SourceBuffer) + length + 1);
+	src->cRef = 1;
+	src->length = length;
+	memcpy(src->aCh, source, length + 1);
+
+	return src;
+}
+
+SourceBuffer * retainSourceBuffer(SourceBuffer * src)
+{
+	int64_t cRefPrev = atomicAdd64(&src->cRef, 1);
+	ASSERT(cRefPrev > 0);
+	UNUSED(cRefPrev);
+
+	return src;
+}
+
+void releaseSourceBuffer(SourceBuffer * src)
+{
+	if (src == NULL)
+		return;
+
+	int64_t cRefPrev = atomicAdd64(&src->cRef, -1);
+	ASSERT(cRefPrev > 0);
+
+	if (cRefPrev == 1)
+	{
+		xfree(src, sizeof(SourceBuffer) + src->length + 1);
+	}
+}
@@ -14,278 +14,955 @@
 #include "object.h"
 #include "array.h"
 
-// Max load of 0.75 (c - c/4 = 0.75c)
-#define TABLE_LOAD_THRESHOLD(_cap) ((_cap) - ((_cap) >> 2))
-#define TABLE_GROW_CAPACITY(_cap) ((_cap) < 8 ? 8 : (_cap) * 2)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TABLE_SSE2 1
+#include <emmintrin.h>
+#else
+#define TABLE_SSE2 0
+#endif
+
+#if TARGET_WINDOWS
+#include <intrin.h>
+#endif
+
+// Max load of 0.875 (c - c/8). Scanning a whole group per probe keeps lookups short even
+//  when the table is this full.
+#define TABLE_LOAD_THRESHOLD(_cap) ((_cap) - ((_cap) >> 3))
+#define TABLE_MIN_CAPACITY 8
+#define TABLE_GROW_CAPACITY(_cap) ((_cap) < TABLE_MIN_CAPACITY ? TABLE_MIN_CAPACITY : (_cap) * 2)
+
+// Shrink once less than 1/8 of the slots are live. Afterwards the table is between 1/4 and
+//  1/2 full, far enough from both thresholds that alternating inserts and deletes don't thrash.
+#define TABLE_SHRINK_THRESHOLD(_cap) ((_cap) >> 3)
+
+// Tables with at least this many slots resize incrementally, moving TABLE_MIGRATE_SLOTS old
+//  slots into the new storage on each operation. The new storage is always big enough to
+//  take every old key plus far more inserts than the migration needs, so it finishes first.
+#ifndef TABLE_INCREMENTAL_CAPACITY
+#define TABLE_INCREMENTAL_CAPACITY (64 * 1024)
+#endif
+#define TABLE_MIGRATE_SLOTS 32
+
+// Control bytes. Full slots hold the low 7 bits of the hash, so only the special values
+//  have the sign bit set
+
+#define CTRL_EMPTY ((int8_t)-128)
+#define CTRL_DELETED ((int8_t)-2)
+
+CASSERT(TABLE_GROUP_SIZE == 16);
+
+struct TableMigration
+{
+	Table table;	// Old storage, keys are removed from it as they move
+	int iSlot;		// Old slots before this have been moved
+};
+
+
+
+static inline uint32_t hashPosition(uint32_t hash)
+{
+	// The low bits go into the control byte, so start probing from the rest
+
+	return hash >> 7;
+}
+
+static inline int8_t hashCtrl(uint32_t hash)
+{
+	return (int8_t)(hash & 0x7f);
+}
+
+static inline int highestBit(uint32_t mask)
+{
+	ASSERT(mask != 0);
+
+#if TARGET_WINDOWS
+	unsigned long iBit;
+	_BitScanReverse(&iBit, mask);
+	return (int)iBit;
+#else
+	return 31 - __builtin_clz(mask);
+#endif
+}
+
+static inline int lowestBit(uint32_t mask)
+{
+	ASSERT(mask != 0);
+
+#if TARGET_WINDOWS
+	unsigned long iBit;
+	_BitScanForward(&iBit, mask);
+	return (int)iBit;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+// Group helpers return one bit per control byte in the group, lowest bit first
+
+static inline uint32_t groupMatch(const int8_t * pCtrl, int8_t ctrl)
+{
+#if TABLE_SSE2
+	__m128i group = _mm_loadu_si128((const __m128i *)pCtrl);
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(ctrl)));
+#else
+	uint32_t mask = 0;
+
+	for (int i = 0; i < TABLE_GROUP_SIZE; ++i)
+	{
+		if (pCtrl[i] == ctrl) mask |= 1u << i;
+	}
+
+	return mask;
+#endif
+}
+
+static inline uint32_t groupMatchNotFull(const int8_t * pCtrl)
+{
+	// Empty or deleted, i.e. the sign bit is set
+
+#if TABLE_SSE2
+	return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)pCtrl));
+#else
+	uint32_t mask = 0;
+
+	for (int i = 0; i < TABLE_GROUP_SIZE; ++i)
+	{
+		if (pCtrl[i] < 0) mask |= 1u << i;
+	}
+
+	return mask;
+#endif
+}
+
+static inline uint32_t groupValidMask(int capacityMask)
+{
+	// Tables smaller than a group see every slot in one group, and the bytes past the
+	//  capacity just repeat the first slots
+
+	int capacity = capacityMask + 1;
+	return capacity >= TABLE_GROUP_SIZE ? 0xffff : (1u << capacity) - 1;
+}
+
+static size_t ctrlSize(int capacity)
+{
+	// Round up so the keys that follow are pointer aligned
+
+	return ((size_t)capacity + TABLE_GROUP_SIZE + 7) & ~(size_t)7;
+}
+
+static size_t storageSize(int capacity)
+{
+	return ctrlSize(capacity) + (size_t)capacity * (sizeof(ObjString *) + sizeof(Value));
+}
+
+static void allocateStorage(Table * table, int capacityMask)
+{
+	ASSERT(IS_POW2(capacityMask + 1));
 
+	int capacity = capacityMask + 1;
+	uint8_t * pB = CARY_ALLOCATE(uint8_t, storageSize(capacity));
 
+	table->count = 0;
+	table->cTombstone = 0;
+	table->capacityMask = capacityMask;
+	table->aCtrl = (int8_t *)pB;
+	table->aKeys = (ObjString **)(pB + ctrlSize(capacity));
+	table->aValues = (Value *)(table->aKeys + capacity);
+	table->migration = NULL;
+
+	memset(table->aCtrl, (uint8_t)CTRL_EMPTY, capacity + TABLE_GROUP_SIZE);
+}
+
+static void setCtrl(int8_t * aCtrl, int capacityMask, int index, int8_t ctrl)
+{
+	// Keep the copies at the end in sync
+
+	int capacity = capacityMask + 1;
+
+	for (int i = index; i < capacity + TABLE_GROUP_SIZE; i += capacity)
+	{
+		aCtrl[i] = ctrl;
+	}
+}
 
 void initTable(Table * table)
 {
 	table->count = 0;
+	table->cTombstone = 0;
 	table->capacityMask = -1;
-	table->aEntries = NULL;
+	table->aCtrl = NULL;
+	table->aKeys = NULL;
+	table->aValues = NULL;
+	table->migration = NULL;
 }
 
 void freeTable(Table * table)
 {
 	ASSERT(table->capacityMask == -1 || IS_POW2(table->capacityMask + 1));
-	CARY_FREE(Entry, table->aEntries, table->capacityMask + 1);
+
+	if (table->migration != NULL)
+	{
+		freeTable(&table->migration->table);
+		xfree(table->migration, sizeof(TableMigration));
+	}
+
+	if (table->aCtrl != NULL)
+	{
+		CARY_FREE(uint8_t, table->aCtrl, storageSize(table->capacityMask + 1));
+	}
+
 	initTable(table);
 }
 
-static Entry * findEntry(Entry * aEntries, int capacityMask, ObjString * key)
+static int findIndex(const Table * table, ObjString * key)
 {
-	uint32_t index = key->hash & capacityMask;
-	Entry * tombstone = NULL;
+	// Returns the slot holding key, or -1
+
+	if (table->aCtrl == NULL) return -1;
+
+	uint32_t validMask = groupValidMask(table->capacityMask);
+	int8_t ctrl = hashCtrl(key->hash);
+	uint32_t pos = hashPosition(key->hash) & table->capacityMask;
 
 	for (;;)
 	{
-		Entry * entry = &aEntries[index];
+		const int8_t * pCtrl = &table->aCtrl[pos];
 
-		if (entry->key == NULL)
+		for (uint32_t match = groupMatch(pCtrl, ctrl) & validMask; match != 0; match &= match - 1)
 		{
-			if (IS_NIL(entry->value))
-			{
-				// Empty entry
+			int index = (pos + lowestBit(match)) & table->capacityMask;
+			if (table->aKeys[index] == key) return index;
+		}
 
-				return tombstone != NULL ? tombstone : entry;
-			}
-			else
-			{
-				// We found a tombstone
+		// Keys are always inserted in the first group with room, so an empty slot
+		//  means the key isn't any further along
 
-				if (tombstone == NULL) tombstone = entry;
-			}
-		}
-		else if (entry->key == key)
-		{
-			return entry;
-		}
+		if (groupMatch(pCtrl, CTRL_EMPTY) & validMask) return -1;
 
-		index = (index + 1) & capacityMask;
+		pos = (pos + TABLE_GROUP_SIZE) & table->capacityMask;
 	}
 
 	// Unreachable
 }
 
-static void adjustCapacity(Table * table, int capacityMask)
+static int findInsertIndex(const int8_t * aCtrl, int capacityMask, uint32_t hash)
 {
-	ASSERT(IS_POW2(capacityMask + 1));
+	// First empty or deleted slot in the probe sequence for hash. The load threshold
+	//  guarantees there is one.
 
-	Entry * aEntries = CARY_ALLOCATE(Entry, capacityMask + 1);
+	uint32_t validMask = groupValidMask(capacityMask);
+	uint32_t pos = hashPosition(hash) & capacityMask;
 
-	for (int i = 0; i <= capacityMask; ++i)
+	for (;;)
 	{
-		aEntries[i].key = NULL;
-		aEntries[i].value = NIL_VAL;
+		uint32_t match = groupMatchNotFull(&aCtrl[pos]) & validMask;
+
+		if (match != 0)
+			return (pos + lowestBit(match)) & capacityMask;
+
+		pos = (pos + TABLE_GROUP_SIZE) & capacityMask;
 	}
 
-	table->count = 0;
+	// Unreachable
+}
+
+static void insertNew(Table * table, ObjString * key, Value value)
+{
+	ASSERT(findIndex(table, key) < 0);
+
+	int index = findInsertIndex(table->aCtrl, table->capacityMask, key->hash);
+
+	if (table->aCtrl[index] == CTRL_DELETED) table->cTombstone--;
+	table->count++;
+
+	setCtrl(table->aCtrl, table->capacityMask, index, hashCtrl(key->hash));
+	table->aKeys[index] = key;
+	table->aValues[index] = value;
+}
+
+static void adjustCapacity(Table * table, int capacityMask)
+{
+	ASSERT(table->migration == NULL);
+
+	Table tableNew;
+	allocateStorage(&tableNew, capacityMask);
+
+	// Tombstones are dropped
 
 	for (int i = 0; i <= table->capacityMask; ++i)
 	{
-		Entry * entry = &table->aEntries[i];
-		if (entry->key == NULL) continue;
+		if (table->aCtrl[i] < 0) continue;
+
+		int index = findInsertIndex(tableNew.aCtrl, tableNew.capacityMask, table->aKeys[i]->hash);
 
-		Entry * dest = findEntry(aEntries, capacityMask, entry->key);
-		dest->key = entry->key;
-		dest->value = entry->value;
-		table->count++;
+		setCtrl(tableNew.aCtrl, tableNew.capacityMask, index, table->aCtrl[i]);
+		tableNew.aKeys[index] = table->aKeys[i];
+		tableNew.aValues[index] = table->aValues[i];
+		tableNew.count++;
 	}
 
-	int oldCapacity = table->capacityMask + 1;
-	ASSERT(oldCapacity == 0 || IS_POW2(oldCapacity));
-	CARY_FREE(Entry, table->aEntries, oldCapacity);
+	freeTable(table);
+	*table = tableNew;
+}
+
+static void beginMigration(Table * table, int capacityMask)
+{
+	ASSERT(table->migration == NULL);
 
-	table->aEntries = aEntries;
-	table->capacityMask = capacityMask;
+	// Allocate everything before touching the table, either allocation may collect garbage
+
+	Table tableNew;
+	allocateStorage(&tableNew, capacityMask);
+
+	TableMigration * migration = xmalloc(sizeof(TableMigration));
+
+	migration->table = *table;
+	migration->table.migration = NULL;
+	migration->iSlot = 0;
+
+	*table = tableNew;
+	table->migration = migration;
 }
 
-static inline void resizeForCount(Table * table, int newCount)
+static void migrateStep(Table * table)
 {
-	int oldCapacity = table->capacityMask + 1;
+	// Move the keys from the next few old slots into the new storage
+
+	TableMigration * migration = table->migration;
+	Table * tableOld = &migration->table;
+
+	int iSlotMac = MIN(migration->iSlot + TABLE_MIGRATE_SLOTS, tableOld->capacityMask + 1);
 
-	if (newCount > TABLE_LOAD_THRESHOLD(oldCapacity))
+	for (int i = migration->iSlot; i < iSlotMac; ++i)
 	{
-		// NOTE (matthewp) We rely on the behavior of TABLE_GROW_CAPACITY giving us power-of-two
-		//  sized capacities to avoid using the modulus operator in findEntry
+		if (tableOld->aCtrl[i] < 0) continue;
 
-		ASSERT(oldCapacity == 0 || IS_POW2(oldCapacity));
+		insertNew(table, tableOld->aKeys[i], tableOld->aValues[i]);
 
-		int capacity;
+		// Lookups still check the old storage, so the moved key has to go
 
-		do
-		{
-			capacity = TABLE_GROW_CAPACITY(oldCapacity);
-		}
-		while (newCount > TABLE_LOAD_THRESHOLD(capacity));
+		setCtrl(tableOld->aCtrl, tableOld->capacityMask, i, CTRL_DELETED);
+		tableOld->count--;
+	}
 
-		ASSERT(IS_POW2(capacity));
-		adjustCapacity(table, capacity - 1);
+	migration->iSlot = iSlotMac;
+
+	if (iSlotMac > tableOld->capacityMask)
+	{
+		ASSERT(tableOld->count == 0);
+
+		freeTable(tableOld);
+		xfree(migration, sizeof(TableMigration));
+		table->migration = NULL;
 	}
 }
 
-bool tableSet(Table * table, ObjString * key, Value value)
+static void finishMigration(Table * table)
+{
+	while (table->migration != NULL)
+	{
+		migrateStep(table);
+	}
+}
+
+static void resize(Table * table, int capacityMask)
+{
+	// Big tables move their keys over a little at a time rather than stalling one insert
+
+	if (table->capacityMask + 1 >= TABLE_INCREMENTAL_CAPACITY && capacityMask >= table->capacityMask)
+	{
+		beginMigration(table, capacityMask);
+	}
+	else
+	{
+		adjustCapacity(table, capacityMask);
+	}
+}
+
+static int capacityForInsert(int capacity, int cOccupied, int count)
 {
-	resizeForCount(table, table->count + 1);
+	// Capacity needed once cOccupied slots are in use (live keys and tombstones) and count of
+	//  them are live keys, or 0 if the current capacity is fine
 
-	Entry * entry = findEntry(table->aEntries, table->capacityMask, key);
+	if (cOccupied <= TABLE_LOAD_THRESHOLD(capacity))
+		return 0;
 
-	// Only increase count if this is a new key and the key is not a tombstone
-	//  (Tombstones are included in the count already)
+	// Mostly tombstones, rehashing at the same size frees up at least half the table
 
-	bool isNewKey = (entry->key == NULL);
+	if (count <= TABLE_LOAD_THRESHOLD(capacity) / 2)
+		return capacity;
 
-	if (isNewKey && IS_NIL(entry->value)) table->count++;
+	// NOTE (matthewp) We rely on the behavior of TABLE_GROW_CAPACITY giving us power-of-two
+	//  sized capacities to avoid using the modulus operator when probing
 
-	entry->key = key;
-	entry->value = value;
+	ASSERT(capacity == 0 || IS_POW2(capacity));
 
-	return isNewKey;
+	do
+	{
+		capacity = TABLE_GROW_CAPACITY(capacity);
+	}
+	while (count > TABLE_LOAD_THRESHOLD(capacity));
+
+	ASSERT(IS_POW2(capacity));
+	return capacity;
 }
 
-bool tableSetIfExists(Table * table, ObjString * key, Value value)
+static int capacityForShrink(int capacity, int count)
+{
+	// Smaller capacity to rehash to once few keys are left, or 0 to keep the current one
+
+	if (capacity <= TABLE_MIN_CAPACITY || count >= TABLE_SHRINK_THRESHOLD(capacity))
+		return 0;
+
+	while (capacity > TABLE_MIN_CAPACITY && count <= (capacity >> 2))
+	{
+		capacity >>= 1;
+	}
+
+	return capacity;
+}
+
+static inline void reserveForInsert(Table * table, int cInsert)
+{
+	if (UNLIKELY(table->migration != NULL))
+	{
+		migrateStep(table);
+	}
+
+	int cMigrating = (table->migration != NULL) ? table->migration->table.count : 0;
+
+	if (table->count + table->cTombstone + cMigrating + cInsert <= TABLE_LOAD_THRESHOLD(table->capacityMask + 1))
+		return;
+
+	// Sizes always leave room to migrate every old key before the new storage
+	//  fills up, this only happens when inserting many keys at once
+
+	finishMigration(table);
+
+	int capacity = capacityForInsert(
+					table->capacityMask + 1,
+					table->count + table->cTombstone + cInsert,
+					table->count + cInsert);
+
+	if (capacity != 0)
+	{
+		resize(table, capacity - 1);
+	}
+}
+
+static void shrinkIfSparse(Table * table)
 {
-	resizeForCount(table, table->count + 1);
+	if (table->migration != NULL)
+		return;
+
+	int capacity = capacityForShrink(table->capacityMask + 1, table->count);
+
+	if (capacity != 0)
+	{
+		adjustCapacity(table, capacity - 1);
+	}
+}
+
+static Table * findKey(Table * table, ObjString * key, int * pIndex)
+{
+	// Table whose storage holds key, which is the old storage if it hasn't been migrated yet
+
+	*pIndex = findIndex(table, key);
+
+	if (*pIndex < 0 && table->migration != NULL)
+	{
+		table = &table->migration->table;
+		*pIndex = findIndex(table, key);
+	}
+
+	return (*pIndex >= 0) ? table : NULL;
+}
 
-	Entry * entry = findEntry(table->aEntries, table->capacityMask, key);
+bool tableSet(Table * table, ObjString * key, Value value)
+{
+	reserveForInsert(table, 1);
 
-	bool isNewKey = (entry->key == NULL);
+	int index;
+	Table * tableKey = findKey(table, key, &index);
 
-	if (isNewKey)
+	if (tableKey != NULL)
+	{
+		tableKey->aValues[index] = value;
 		return false;
+	}
 
-	entry->key = key;
-	entry->value = value;
+	insertNew(table, key, value);
 
 	return true;
 }
 
-bool tableSetIfNew(Table * table, ObjString * key, Value value)
+bool tableSetIfExists(Table * table, ObjString * key, Value value)
 {
-	resizeForCount(table, table->count + 1);
+	if (UNLIKELY(table->migration != NULL))
+	{
+		migrateStep(table);
+	}
 
-	Entry * entry = findEntry(table->aEntries, table->capacityMask, key);
+	int index;
+	Table * tableKey = findKey(table, key, &index);
 
-	// Only increase count if this is a new key and the key is not a tombstone
-	//  (Tombstones are included in the count already)
+	if (tableKey == NULL)
+		return false;
 
-	bool isNewKey = (entry->key == NULL);
+	tableKey->aValues[index] = value;
 
-	if (!isNewKey)
-		return false;
+	return true;
+}
 
-	if (IS_NIL(entry->value)) table->count++;
+bool tableSetIfNew(Table * table, ObjString * key, Value value)
+{
+	reserveForInsert(table, 1);
 
-	entry->key = key;
-	entry->value = value;
+	int index;
+	if (findKey(table, key, &index) != NULL)
+		return false;
+
+	insertNew(table, key, value);
 
 	return true;
 }
 
 bool tableGet(Table * table, ObjString * key, Value * value)
 {
-	if (table->aEntries == NULL) return false;
+	if (UNLIKELY(table->migration != NULL))
+	{
+		migrateStep(table);
+	}
 
-	Entry * entry = findEntry(table->aEntries, table->capacityMask, key);
-	if (entry->key == NULL) return false;
+	int index;
+	Table * tableKey = findKey(table, key, &index);
+	if (tableKey == NULL) return false;
 
-	*value = entry->value;
+	*value = tableKey->aValues[index];
 	return true;
 }
 
-bool tableDelete(Table * table, ObjString * key)
+static bool wasNeverFull(const int8_t * aCtrl, int capacityMask, int index)
+{
+	// A probe only moves past a group with no empty slots. If every group this slot could
+	//  have been part of has an empty slot, no probe has ever gone past it.
+
+	int capacity = capacityMask + 1;
+
+	if (capacity < TABLE_GROUP_SIZE)
+		return true;
+
+	uint32_t emptyAfter = groupMatch(&aCtrl[index], CTRL_EMPTY);
+	uint32_t emptyBefore = groupMatch(&aCtrl[(index - TABLE_GROUP_SIZE) & capacityMask], CTRL_EMPTY);
+
+	if (emptyAfter == 0 || emptyBefore == 0)
+		return false;
+
+	// Run of full or deleted slots around index, the slots after it in one group and the
+	//  slots before it in the other
+
+	int cAfter = lowestBit(emptyAfter);
+	int cBefore = TABLE_GROUP_SIZE - 1 - highestBit(emptyBefore);
+
+	return cAfter + cBefore < TABLE_GROUP_SIZE;
+}
+
+static void deleteIndex(Table * table, int index)
 {
-	if (table->count == 0) return false;
+	// Leave a tombstone unless no probe sequence can have passed this slot, in which case
+	//  it can go straight back to empty
 
-	// Find the entry.
+	if (wasNeverFull(table->aCtrl, table->capacityMask, index))
+	{
+		setCtrl(table->aCtrl, table->capacityMask, index, CTRL_EMPTY);
+	}
+	else
+	{
+		setCtrl(table->aCtrl, table->capacityMask, index, CTRL_DELETED);
+		table->cTombstone++;
+	}
 
-	Entry * entry = findEntry(table->aEntries, table->capacityMask, key);
-	if (entry->key == NULL) return false;
+	table->count--;
+	table->aKeys[index] = NULL;
+	table->aValues[index] = NIL_VAL;
+}
 
-	// Place a tombstone in the entry
+bool tableDelete(Table * table, ObjString * key)
+{
+	if (UNLIKELY(table->migration != NULL))
+	{
+		migrateStep(table);
+	}
+
+	int index;
+	Table * tableKey = findKey(table, key, &index);
+	if (tableKey == NULL) return false;
 
-	entry->key = NULL;
-	entry->value = BOOL_VAL(true);
+	deleteIndex(tableKey, index);
+	shrinkIfSparse(table);
 
 	return true;
 }
 
 void tableAddAll(Table * from, Table * to)
 {
-	resizeForCount(to, to->count + from->count);
+	reserveForInsert(to, from->count + ((from->migration != NULL) ? from->migration->table.count : 0));
 
 	for (int i = 0; i <= from->capacityMask; ++i)
 	{
-		Entry * entry = &from->aEntries[i];
-
-		if (entry->key != NULL)
+		if (from->aCtrl[i] >= 0)
 		{
-			tableSet(to, entry->key, entry->value);
+			tableSet(to, from->aKeys[i], from->aValues[i]);
 		}
 	}
+
+	if (from->migration != NULL)
+	{
+		tableAddAll(&from->migration->table, to);
+	}
 }
 
-ObjString * tableFindString(Table * table, const char * aCh, int length, uint32_t hash)
+static ObjString * findString(Table * table, const char * aCh, int length, uint32_t hash)
 {
 	// If the table is empty, we definitely won't find it
 
-	if (table->aEntries == NULL) return NULL;
-
-	// Figure out where to insert in the table. Use open addressing and basic linear probing
+	if (table->aCtrl == NULL) return NULL;
 
-	uint32_t index = hash & table->capacityMask;
+	uint32_t validMask = groupValidMask(table->capacityMask);
+	int8_t ctrl = hashCtrl(hash);
+	uint32_t pos = hashPosition(hash) & table->capacityMask;
 
 	for (;;)
 	{
-		Entry * entry = &table->aEntries[index];
+		const int8_t * pCtrl = &table->aCtrl[pos];
 
-		// BB (matthewp) Return Entry* instead (like findEntry does) so that we immediately know where
-		//  to insert this string when doing a string interning operation in object.c::allocateString.
-		//  This avoids doing the bucket probe twice.
-
-		if (entry->key == NULL)
-		{
-			if (IS_NIL(entry->value))
-				return NULL;
-		}
-		else if (entry->key->length == length &&
-			entry->key->hash == hash &&
-			memcmp(entry->key->aChars, aCh, length) == 0)
+		for (uint32_t match = groupMatch(pCtrl, ctrl) & validMask; match != 0; match &= match - 1)
 		{
-			// Found it
+			ObjString * key = table->aKeys[(pos + lowestBit(match)) & table->capacityMask];
 
-			return entry->key;
+			if (key->hash == hash &&
+				key->length == length &&
+				memcmp(key->aChars, aCh, length) == 0)
+			{
+				// Found it
+
+				return key;
+			}
 		}
 
-		// Try the next slot
+		if (groupMatch(pCtrl, CTRL_EMPTY) & validMask) return NULL;
 
-		index = (index + 1) & table->capacityMask;
+		// Try the next group
+
+		pos = (pos + TABLE_GROUP_SIZE) & table->capacityMask;
 	}
 
 	// Unreachable
 }
 
+ObjString * tableFindString(Table * table, const char * aCh, int length, uint32_t hash)
+{
+	// TODO Return the insert position as well so that string interning in object.c
+	//  doesn't need to probe a second time when the string isn't found.
+
+	ObjString * str = findString(table, aCh, length, hash);
+
+	if (str == NULL && table->migration != NULL)
+	{
+		str = findString(&table->migration->table, aCh, length, hash);
+	}
+
+	return str;
+}
+
 void markTable(Table* table)
 {
 	for (int i = 0; i <= table->capacityMask; i++)
 	{
-		Entry* entry = &table->aEntries[i];
-		markObject((Obj*)entry->key);
-		markValue(entry->value);
+		if (table->aCtrl[i] < 0) continue;
+
+		markObject((Obj*)table->aKeys[i]);
+		markValue(table->aValues[i]);
+	}
+
+	if (table->migration != NULL)
+	{
+		markTable(&table->migration->table);
+	}
+}
+
+static void removeWhiteKeys(Table * table)
+{
+	for (int i = 0; i <= table->capacityMask; i++)
+	{
+		if (table->aCtrl[i] >= 0 && !getIsMarked(&table->aKeys[i]->obj))
+		{
+			deleteIndex(table, i);
+		}
 	}
 }
 
 void tableRemoveWhite(Table* table)
 {
-	for (int i = 0; i <= table->capacityMask; i++)
+	removeWhiteKeys(table);
+
+	// The old storage of a migration is swept but never rehashed, migration->iSlot only makes
+	//  sense in its current layout. shrinkIfSparse waits for the migration to finish.
+
+	if (table->migration != NULL)
+	{
+		removeWhiteKeys(&table->migration->table);
+	}
+
+	shrinkIfSparse(table);
+}
+
+
+
+static size_t valueStorageSize(int capacity)
+{
+	return ctrlSize(capacity) + (size_t)capacity * 2 * sizeof(Value);
+}
+
+static void allocateValueStorage(ValueTable * vtable, int capacityMask)
+{
+	ASSERT(IS_POW2(capacityMask + 1));
+
+	int capacity = capacityMask + 1;
+	uint8_t * pB = CARY_ALLOCATE(uint8_t, valueStorageSize(capacity));
+
+	vtable->count = 0;
+	vtable->cTombstone = 0;
+	vtable->capacityMask = capacityMask;
+	vtable->aCtrl = (int8_t *)pB;
+	vtable->aKeys = (Value *)(pB + ctrlSize(capacity));
+	vtable->aValues = vtable->aKeys + capacity;
+
+	memset(vtable->aCtrl, (uint8_t)CTRL_EMPTY, capacity + TABLE_GROUP_SIZE);
+}
+
+void initValueTable(ValueTable * vtable)
+{
+	vtable->count = 0;
+	vtable->cTombstone = 0;
+	vtable->capacityMask = -1;
+	vtable->aCtrl = NULL;
+	vtable->aKeys = NULL;
+	vtable->aValues = NULL;
+}
+
+void freeValueTable(ValueTable * vtable)
+{
+	if (vtable->aCtrl != NULL)
+	{
+		CARY_FREE(uint8_t, vtable->aCtrl, valueStorageSize(vtable->capacityMask + 1));
+	}
+
+	initValueTable(vtable);
+}
+
+static int findValueIndex(const ValueTable * vtable, Value key, uint32_t hash)
+{
+	if (vtable->aCtrl == NULL) return -1;
+
+	uint32_t validMask = groupValidMask(vtable->capacityMask);
+	int8_t ctrl = hashCtrl(hash);
+	uint32_t pos = hashPosition(hash) & vtable->capacityMask;
+
+	for (;;)
+	{
+		const int8_t * pCtrl = &vtable->aCtrl[pos];
+
+		for (uint32_t match = groupMatch(pCtrl, ctrl) & validMask; match != 0; match &= match - 1)
+		{
+			int index = (pos + lowestBit(match)) & vtable->capacityMask;
+			if (valuesSame(vtable->aKeys[index], key)) return index;
+		}
+
+		if (groupMatch(pCtrl, CTRL_EMPTY) & validMask) return -1;
+
+		pos = (pos + TABLE_GROUP_SIZE) & vtable->capacityMask;
+	}
+
+	// Unreachable
+}
+
+static void adjustValueCapacity(ValueTable * vtable, int capacityMask)
+{
+	ValueTable vtableNew;
+	allocateValueStorage(&vtableNew, capacityMask);
+
+	for (int i = 0; i <= vtable->capacityMask; ++i)
+	{
+		if (vtable->aCtrl[i] < 0) continue;
+
+		int index = findInsertIndex(vtableNew.aCtrl, capacityMask, hashValue(vtable->aKeys[i]));
+
+		setCtrl(vtableNew.aCtrl, capacityMask, index, vtable->aCtrl[i]);
+		vtableNew.aKeys[index] = vtable->aKeys[i];
+		vtableNew.aValues[index] = vtable->aValues[i];
+		vtableNew.count++;
+	}
+
+	freeValueTable(vtable);
+	*vtable = vtableNew;
+}
+
+bool valueTableSet(ValueTable * vtable, Value key, Value value)
+{
+	uint32_t hash = hashValue(key);
+	int index = findValueIndex(vtable, key, hash);
+
+	if (index >= 0)
+	{
+		vtable->aValues[index] = value;
+		return false;
+	}
+
+	int capacity = capacityForInsert(
+					vtable->capacityMask + 1,
+					vtable->count + vtable->cTombstone + 1,
+					vtable->count + 1);
+
+	// Sparse tables shrink on the next insert rather than on delete, so that
+	//  scripts can delete keys while iterating
+
+	if (capacity == 0)
+	{
+		capacity = capacityForShrink(vtable->capacityMask + 1, vtable->count + 1);
+	}
+
+	if (capacity != 0)
+	{
+		adjustValueCapacity(vtable, capacity - 1);
+	}
+
+	index = findInsertIndex(vtable->aCtrl, vtable->capacityMask, hash);
+
+	if (vtable->aCtrl[index] == CTRL_DELETED) vtable->cTombstone--;
+	vtable->count++;
+
+	// Stored string keys are interned so later lookups can match on identity. Done last, since
+	//  if the key turns out to have an interned twin, only the table keeps that twin alive.
+
+	if (IS_STRING(key))
+	{
+		key = OBJ_VAL(internString(AS_STRING(key)));
+	}
+
+	setCtrl(vtable->aCtrl, vtable->capacityMask, index, hashCtrl(hash));
+	vtable->aKeys[index] = key;
+	vtable->aValues[index] = value;
+
+	return true;
+}
+
+bool valueTableGet(ValueTable * vtable, Value key, Value * value)
+{
+	int index = findValueIndex(vtable, key, hashValue(key));
+	if (index < 0) return false;
+
+	*value = vtable->aValues[index];
+	return true;
+}
+
+static void deleteValueIndex(ValueTable * vtable, int index)
+{
+	if (wasNeverFull(vtable->aCtrl, vtable->capacityMask, index))
+	{
+		setCtrl(vtable->aCtrl, vtable->capacityMask, index, CTRL_EMPTY);
+	}
+	else
+	{
+		setCtrl(vtable->aCtrl, vtable->capacityMask, index, CTRL_DELETED);
+		vtable->cTombstone++;
+	}
+
+	vtable->count--;
+	vtable->aKeys[index] = NIL_VAL;
+	vtable->aValues[index] = NIL_VAL;
+}
+
+bool valueTableDelete(ValueTable * vtable, Value key)
+{
+	int index = findValueIndex(vtable, key, hashValue(key));
+	if (index < 0) return false;
+
+	deleteValueIndex(vtable, index);
+
+	return true;
+}
+
+int valueTableNext(ValueTable * vtable, int iSlot)
+{
+	for (int i = MAX(iSlot, 0); i <= vtable->capacityMask; ++i)
+	{
+		if (vtable->aCtrl[i] >= 0) return i;
+	}
+
+	return -1;
+}
+
+void markValueTable(ValueTable * vtable)
+{
+	for (int i = 0; i <= vtable->capacityMask; i++)
+	{
+		if (vtable->aCtrl[i] < 0) continue;
+
+		markValue(vtable->aKeys[i]);
+		markValue(vtable->aValues[i]);
+	}
+}
+
+static inline bool isWeakKey(Value key)
+{
+	return IS_OBJ(key) && !IS_STRING(key);
+}
+
+static inline bool isUnmarkedObj(Value value)
+{
+	return IS_OBJ(value) && !getIsMarked(AS_OBJ(value));
+}
+
+bool markValueTableEphemerons(ValueTable * vtable)
+{
+	bool markedAny = false;
+
+	for (int i = 0; i <= vtable->capacityMask; i++)
 	{
-		Entry* entry = &table->aEntries[i];
+		if (vtable->aCtrl[i] < 0) continue;
 
-		if (entry->key != NULL && !getIsMarked(&entry->key->obj))
+		Value key = vtable->aKeys[i];
+		Value value = vtable->aValues[i];
+
+		if (isWeakKey(key))
+		{
+			if (!getIsMarked(AS_OBJ(key)))
+				continue;
+		}
+		else if (isUnmarkedObj(key))
+		{
+			markValue(key);
+			markedAny = true;
+		}
+
+		if (isUnmarkedObj(value))
+		{
+			markValue(value);
+			markedAny = true;
+		}
+	}
+
+	return markedAny;
+}
+
+void valueTableRemoveWhite(ValueTable * vtable)
+{
+	for (int i = 0; i <= vtable->capacityMask; i++)
+	{
+		if (vtable->aCtrl[i] >= 0 && isWeakKey(vtable->aKeys[i]) && !getIsMarked(AS_OBJ(vtable->aKeys[i])))
 		{
-			tableDelete(table, entry->key);
+			deleteValueIndex(vtable, i);
 		}
 	}
 }
@@ -0,0 +1,230 @@
+//
+//  thread.c
+//  clox
+//
+
+#include "thread.h"
+
+#include <stdlib.h>
+
+#if TARGET_WINDOWS
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+
+
+#if TARGET_WINDOWS
+
+struct Thread
+{
+	HANDLE handle;
+	ThreadFn function;
+	void * arg;
+};
+
+struct Mutex
+{
+	SRWLOCK lock;
+};
+
+struct CondVar
+{
+	CONDITION_VARIABLE cv;
+};
+
+static DWORD WINAPI threadMain(LPVOID param)
+{
+	Thread * thread = (Thread *)param;
+	thread->function(thread->arg);
+	return 0;
+}
+
+Thread * startThread(ThreadFn function, void * arg)
+{
+	Thread * thread = (Thread *)malloc(sizeof(Thread));
+	ASSERTMSG(thread != NULL, "Out of memory!");
+
+	thread->function = function;
+	thread->arg = arg;
+	thread->handle = CreateThread(NULL, 0, threadMain, thread, 0, NULL);
+
+	if (thread->handle == NULL)
+	{
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+void joinThread(Thread * thread)
+{
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+	free(thread);
+}
+
+Mutex * newMutex(void)
+{
+	Mutex * mutex = (Mutex *)malloc(sizeof(Mutex));
+	ASSERTMSG(mutex != NULL, "Out of memory!");
+
+	InitializeSRWLock(&mutex->lock);
+	return mutex;
+}
+
+void freeMutex(Mutex * mutex)
+{
+	free(mutex);
+}
+
+void lockMutex(Mutex * mutex)
+{
+	AcquireSRWLockExclusive(&mutex->lock);
+}
+
+void unlockMutex(Mutex * mutex)
+{
+	ReleaseSRWLockExclusive(&mutex->lock);
+}
+
+CondVar * newCondVar(void)
+{
+	CondVar * condvar = (CondVar *)malloc(sizeof(CondVar));
+	ASSERTMSG(condvar != NULL, "Out of memory!");
+
+	InitializeConditionVariable(&condvar->cv);
+	return condvar;
+}
+
+void freeCondVar(CondVar * condvar)
+{
+	free(condvar);
+}
+
+void waitCondVar(CondVar * condvar, Mutex * mutex)
+{
+	SleepConditionVariableSRW(&condvar->cv, &mutex->lock, INFINITE, 0);
+}
+
+void broadcastCondVar(CondVar * condvar)
+{
+	WakeAllConditionVariable(&condvar->cv);
+}
+
+int getProcessorCount(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+}
+
+#else // !TARGET_WINDOWS
+
+struct Thread
+{
+	pthread_t handle;
+	ThreadFn function;
+	void * arg;
+};
+
+struct Mutex
+{
+	pthread_mutex_t lock;
+};
+
+struct CondVar
+{
+	pthread_cond_t cv;
+};
+
+static void * threadMain(void * param)
+{
+	Thread * thread = (Thread *)param;
+	thread->function(thread->arg);
+	return NULL;
+}
+
+Thread * startThread(ThreadFn function, void * arg)
+{
+	Thread * thread = (Thread *)malloc(sizeof(Thread));
+	ASSERTMSG(thread != NULL, "Out of memory!");
+
+	thread->function = function;
+	thread->arg = arg;
+
+	if (pthread_create(&thread->handle, NULL, threadMain, thread) != 0)
+	{
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+void joinThread(Thread * thread)
+{
+	pthread_join(thread->handle, NULL);
+	free(thread);
+}
+
+Mutex * newMutex(void)
+{
+	Mutex * mutex = (Mutex *)malloc(sizeof(Mutex));
+	ASSERTMSG(mutex != NULL, "Out of memory!");
+
+	pthread_mutex_init(&mutex->lock, NULL);
+	return mutex;
+}
+
+void freeMutex(Mutex * mutex)
+{
+	pthread_mutex_destroy(&mutex->lock);
+	free(mutex);
+}
+
+void lockMutex(Mutex * mutex)
+{
+	pthread_mutex_lock(&mutex->lock);
+}
+
+void unlockMutex(Mutex * mutex)
+{
+	pthread_mutex_unlock(&mutex->lock);
+}
+
+CondVar * newCondVar(void)
+{
+	CondVar * condvar = (CondVar *)malloc(sizeof(CondVar));
+	ASSERTMSG(condvar != NULL, "Out of memory!");
+
+	pthread_cond_init(&condvar->cv, NULL);
+	return condvar;
+}
+
+void freeCondVar(CondVar * condvar)
+{
+	pthread_cond_destroy(&condvar->cv);
+	free(condvar);
+}
+
+void waitCondVar(CondVar * condvar, Mutex * mutex)
+{
+	pthread_cond_wait(&condvar->cv, &mutex->lock);
+}
+
+void broadcastCondVar(CondVar * condvar)
+{
+	pthread_cond_broadcast(&condvar->cv);
+}
+
+int getProcessorCount(void)
+{
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0) ? (int)count : 1;
+}
+
+#endif // !TARGET_WINDOWS
@@ -10,9 +10,9 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <math.h>
-#include <limits.h>
 #include "object.h"
+#include "output.h"
+#include "number.h"
 
 
 
@@ -25,7 +25,12 @@ bool valuesEqual(Value a, Value b)
 	if (IS_NUMBER(a) && IS_NUMBER(b))
 		return (AS_NUMBER(a) == AS_NUMBER(b));
 
-	return (a == b);
+	if (a == b)
+		return true;
+
+	// Strings that aren't interned can be equal without being the same object
+
+	return IS_STRING(a) && IS_STRING(b) && stringsEqual(AS_STRING(a), AS_STRING(b));
 
 #else // !VALUES_USE_NAN_BOXING
 
@@ -42,6 +47,9 @@ bool valuesEqual(Value a, Value b)
 		case VAL_NUMBER:	return AS_NUMBER(a) == AS_NUMBER(b);
 		case VAL_OBJ:
 		{
+			if (IS_STRING(a) && IS_STRING(b))
+				return stringsEqual(AS_STRING(a), AS_STRING(b));
+
 			return AS_OBJ(a) == AS_OBJ(b);
 		}
 	}
@@ -54,28 +62,126 @@ bool valuesEqual(Value a, Value b)
 #endif // !VALUES_USE_NAN_BOXING
 }
 
-static inline void printNumber(double v)
+bool valuesSame(Value a, Value b)
 {
-	double i;
-	double f = modf(v, &i);
+	if (IS_INT(a) && IS_INT(b))
+		return a == b;
 
-	if (f == 0.0 && i >= LLONG_MIN && i <= LLONG_MAX)
+	if (IS_NUMBER(a) && IS_NUMBER(b))
 	{
-		printf("%lld", (long long)i);
+		double numA = AS_NUMBER(a);
+		double numB = AS_NUMBER(b);
+
+		return numA == numB || (numA != numA && numB != numB);
 	}
-	else
+
+	return valuesEqual(a, b);
+}
+
+static inline uint32_t hashBits(uint64_t n)
+{
+	// 64-bit finalizer from MurmurHash3
+
+	n ^= n >> 33;
+	n *= 0xff51afd7ed558ccdull;
+	n ^= n >> 33;
+	n *= 0xc4ceb9fe1a85ec53ull;
+	n ^= n >> 33;
+
+	return (uint32_t)n;
+}
+
+static inline uint32_t hashInt(int32_t n)
+{
+	// Most numbers used as keys are small integers, which only need a multiply. The high bits of
+	//  the product are folded down since tables index with the low bits.
+
+	uint32_t hash = (uint32_t)n * 0x9e3779b1u;
+	return hash ^ (hash >> 16);
+}
+
+static inline uint32_t hashNumber(double num)
+{
+	// Integers stored as doubles hash the same as tagged ones
+
+	if (num >= INT32_MIN && num <= INT32_MAX)
 	{
-		printf("%f", v);
+		int32_t n = (int32_t)num;
+
+		if ((double)n == num)
+			return hashInt(n);
 	}
+
+	// Every NaN is the same key, and -0.0 is already handled above
+
+	if (num != num) return 0x7ff80000u;
+
+	uint64_t bits;
+	memcpy(&bits, &num, sizeof(bits));
+	return hashBits(bits);
+}
+
+uint32_t hashValue(Value value)
+{
+	switch (VAL_TYPE(value))
+	{
+		case VAL_BOOL:		return AS_BOOL(value) ? 1 : 2;
+		case VAL_NIL:		return 3;
+		case VAL_NUMBER:	return IS_INT(value) ? hashInt(AS_INT(value)) : hashNumber(AS_NUMBER(value));
+		case VAL_OBJ:
+		{
+			// Strings hash by content, so ones that aren't interned match their interned twin
+
+			Obj * obj = AS_OBJ(value);
+
+			if (getObjType(obj) == OBJ_STRING)
+				return getStringHash((ObjString *)obj);
+
+			return hashBits((uint64_t)(uintptr_t)obj);
+		}
+	}
+
+	// Unreachable
+
+	ASSERT(false);
+	return 0;
+}
+
+CASSERT(NUMBER_FORMAT_MAX >= NUMBER_DIGITS_MAX);
+
+int formatNumber(double num, char * aCh, int cChMax)
+{
+	ASSERT(cChMax >= NUMBER_FORMAT_MAX);
+	UNUSED(cChMax);
+
+	return formatDouble(num, aCh);
+}
+
+static inline void printNumber(double num)
+{
+	char aCh[NUMBER_FORMAT_MAX];
+	writeOutput(aCh, formatNumber(num, aCh, sizeof(aCh)));
 }
 
 void printValue(Value value)
 {
 	switch (VAL_TYPE(value))
 	{
-		case VAL_BOOL:		printf(AS_BOOL(value) ? "true" : "false"); break;
-		case VAL_NIL:		printf("nil"); break;
-		case VAL_NUMBER:	printNumber(AS_NUMBER(value)); break;
+		case VAL_BOOL:		writeOutputString(AS_BOOL(value) ? "true" : "false"); break;
+		case VAL_NIL:		writeOutput("nil", 3); break;
+		case VAL_NUMBER:
+		{
+			if (IS_INT(value))
+			{
+				char aCh[NUMBER_FORMAT_MAX];
+				writeOutput(aCh, formatInt64(AS_INT(value), aCh));
+			}
+			else
+			{
+				printNumber(AS_NUMBER(value));
+			}
+			break;
+		}
 		case VAL_OBJ:		printObject(value); break;
 	}
 }
@@ -18,6 +18,11 @@
 #include "compiler.h"
 #include "object.h"
 #include "memory.h"
+#include "array.h"
+#include "sort.h"
+#include "f64array.h"
+#include "json.h"
+#include "number.h"
 
 
 
@@ -26,25 +31,76 @@ VM vm; // TODO (matthewp) Make this not a global!
 static void resetStack(void);
 static bool callValue(Value callee, int argCount);
 static void defineNative(const char * name, NativeFn function);
+static ObjClass * defineNativeClass(const char * name);
+static void defineNativeMethod(ObjClass * klass, const char * name, NativeFn function);
 
 static bool clockNative(int argCount, Value * args);
 static bool errNative(int argCount, Value * args);
 static bool getNative(int argCount, Value * args);
 static bool deleteNative(int argCount, Value * args);
 static bool isNative(int argCount, Value * args);
+static bool mapNative(int argCount, Value * args);
+static bool setNative(int argCount, Value * args);
+static bool hasNative(int argCount, Value * args);
+static bool sizeNative(int argCount, Value * args);
+static bool nextNative(int argCount, Value * args);
+static bool keyAtNative(int argCount, Value * args);
+static bool valueAtNative(int argCount, Value * args);
+static bool pushNative(int argCount, Value * args);
+static bool popNative(int argCount, Value * args);
+static bool lengthNative(int argCount, Value * args);
+static bool sliceNative(int argCount, Value * args);
+static bool sortNative(int argCount, Value * args);
+static bool f64ArrayNative(int argCount, Value * args);
+static bool f64AddNative(int argCount, Value * args);
+static bool f64MulNative(int argCount, Value * args);
+static bool f64AxpyNative(int argCount, Value * args);
+static bool f64ScaleNative(int argCount, Value * args);
+static bool f64FillNative(int argCount, Value * args);
+static bool f64PrefixSumNative(int argCount, Value * args);
+static bool f64SumNative(int argCount, Value * args);
+static bool f64DotNative(int argCount, Value * args);
+static bool f64MinNative(int argCount, Value * args);
+static bool f64MaxNative(int argCount, Value * args);
+static bool stringBuilderNative(int argCount, Value * args);
+static bool appendNative(int argCount, Value * args);
+static bool toStringNative(int argCount, Value * args);
+static bool substringNative(int argCount, Value * args);
+static bool splitNative(int argCount, Value * args);
+static bool weakMapNative(int argCount, Value * args);
+static bool weakRefNative(int argCount, Value * args);
+static bool derefNative(int argCount, Value * args);
+static bool gcNative(int argCount, Value * args);
+static bool memoizeNative(int argCount, Value * args);
+static bool jsonParseNative(int argCount, Value * args);
+static bool jsonStringifyNative(int argCount, Value * args);
+static bool stringLengthMethod(int argCount, Value * args);
+static bool stringIndexOfMethod(int argCount, Value * args);
+static bool stringSliceMethod(int argCount, Value * args);
+static bool stringSplitMethod(int argCount, Value * args);
+static bool stringToNumberMethod(int argCount, Value * args);
 
 void initVM(void)
 {
+	initHashSeed();
 	resetStack();
 	vm.objects = NULL;
 	initTable(&vm.globals);
 	initTable(&vm.strings);
 	vm.openUpvalues = NULL;
+	vm.stringClass = NULL;
+
+	// Debug output is printed straight to stdout, so print can't hold onto anything
+
+	initOutput((DEBUG_TRACE_EXECUTION || DEBUG_PRINT_CODE || DEBUG_LOG_GC) ? OUTPUT_UNBUFFERED : OUTPUT_FULL_BUFFERED);
 	vm.grayStack = NULL;
+	vm.aryWeakMap = NULL;
+	vm.aryWeakRef = NULL;
 	vm.bytesAllocated = 0;
 	vm.bytesAllocatedMax = 0;
 	vm.nextGC = 64 * 1024;
 	vm.runningGC = false;
+	vm.multithreaded = false;
 	vm.initString = copyString("init", 4);
 
 	defineNative("clock", clockNative);
@@ -52,18 +108,63 @@ void initVM(void)
 	defineNative("get", getNative);
 	defineNative("delete", deleteNative);
 	defineNative("is", isNative);
+	defineNative("Map", mapNative);
+	defineNative("set", setNative);
+	defineNative("has", hasNative);
+	defineNative("size", sizeNative);
+	defineNative("next", nextNative);
+	defineNative("keyAt", keyAtNative);
+	defineNative("valueAt", valueAtNative);
+	defineNative("push", pushNative);
+	defineNative("pop", popNative);
+	defineNative("length", lengthNative);
+	defineNative("slice", sliceNative);
+	defineNative("sort", sortNative);
+	defineNative("F64Array", f64ArrayNative);
+	defineNative("f64Add", f64AddNative);
+	defineNative("f64Mul", f64MulNative);
+	defineNative("f64Axpy", f64AxpyNative);
+	defineNative("f64Scale", f64ScaleNative);
+	defineNative("f64Fill", f64FillNative);
+	defineNative("f64PrefixSum", f64PrefixSumNative);
+	defineNative("f64Sum", f64SumNative);
+	defineNative("f64Dot", f64DotNative);
+	defineNative("f64Min", f64MinNative);
+	defineNative("f64Max", f64MaxNative);
+	defineNative("StringBuilder", stringBuilderNative);
+	defineNative("append", appendNative);
+	defineNative("toString", toStringNative);
+	defineNative("substring", substringNative);
+	defineNative("split", splitNative);
+	defineNative("WeakMap", weakMapNative);
+	defineNative("WeakRef", weakRefNative);
+	defineNative("deref", derefNative);
+	defineNative("gc", gcNative);
+	defineNative("memoize", memoizeNative);
+	defineNative("jsonParse", jsonParseNative);
+	defineNative("jsonStringify", jsonStringifyNative);
+
+	vm.stringClass = defineNativeClass("String");
+	defineNativeMethod(vm.stringClass, "length", stringLengthMethod);
+	defineNativeMethod(vm.stringClass, "indexOf", stringIndexOfMethod);
+	defineNativeMethod(vm.stringClass, "slice", stringSliceMethod);
+	defineNativeMethod(vm.stringClass, "split", stringSplitMethod);
+	defineNativeMethod(vm.stringClass, "toNumber", stringToNumberMethod);
 }
 
 void freeVM(void)
 {
+	flushOutput();
+
 	freeTable(&vm.globals);
 	freeTable(&vm.strings);
 	vm.initString = NULL;
+	vm.stringClass = NULL;
 	freeObjects();
 
-	// BB (matthewp) Use array/memory helpers here
-
-	free(vm.grayStack);
+	ARY_FREE(vm.grayStack);
+	ARY_FREE(vm.aryWeakMap);
+	ARY_FREE(vm.aryWeakRef);
 
 	ASSERTMSG(vm.bytesAllocated == 0, "Memory leak detected! (vm.bytesAllocated=%zu)", vm.bytesAllocated);
 
@@ -125,95 +226,1050 @@ InterpretResult interpret(const char * source)
 	return interpretFunction(function);
 }
 
-InterpretResult interpretFunction(ObjFunction * function)
+InterpretResult interpretFunction(ObjFunction * function)
+{
+	// A null name indicates the root "function" (the script itself)
+
+	ASSERT(function);
+	ASSERT(function->name == NULL);
+
+	push(OBJ_VAL(function));
+	ObjClosure * closure = newClosure(function);
+	pop();
+	push(OBJ_VAL(closure));
+	callValue(OBJ_VAL(closure), 0);
+
+	return run();
+}
+
+static void resetStack(void)
+{
+	// Memoized calls being unwound will never return, drop the arguments they were keeping for the cache
+
+	for (int iFrame = vm.frameCount - 1; iFrame >= 0; --iFrame)
+	{
+		CallFrame * frame = &vm.frames[iFrame];
+
+		if (frame->memo != NULL)
+		{
+			ARY_TRUNCATE(frame->memo->cache.aryArgPending, frame->iArgPending);
+		}
+	}
+
+	vm.stackTop = vm.stack;
+	vm.frameCount = 0;
+}
+
+static bool clockNative(int argCount, Value * args)
+{
+	UNUSED(argCount);
+	args[-1] = NUMBER_VAL((double)clock() / CLOCKS_PER_SEC);
+	return true;
+}
+
+static bool errNative(int argCount, Value * args)
+{
+	if (argCount > 0 && IS_STRING(args[0]))
+	{
+		args[-1] = args[0];
+	}
+	else
+	{
+		args[-1] = OBJ_VAL(copyString("Runtime Error", 13));
+	}
+
+	return false;
+}
+
+static bool getNative(int argCount, Value * args)
+{
+	if ((argCount == 2 || argCount == 3) && IS_INSTANCE(args[0]) && IS_STRING(args[1]))
+	{
+		ObjInstance* instance = AS_INSTANCE(args[0]);
+		ObjString* name = internString(AS_STRING(args[1]));
+		Value value;
+		if (!tableGet(&instance->fields, name, &value)) value = (argCount == 2) ? NIL_VAL : args[2];
+		args[-1] = value;
+		return true;
+	}
+
+	if ((argCount == 2 || argCount == 3) && IS_MAP(args[0]))
+	{
+		Value value;
+		if (!valueTableGet(&AS_MAP(args[0])->table, args[1], &value)) value = (argCount == 2) ? NIL_VAL : args[2];
+		args[-1] = value;
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to get", 24));
+	return false;
+}
+
+static bool deleteNative(int argCount, Value * args)
+{
+	if (argCount == 2 && IS_INSTANCE(args[0]) && IS_STRING(args[1]))
+	{
+		ObjInstance* instance = AS_INSTANCE(args[0]);
+		ObjString* name = internString(AS_STRING(args[1]));
+		args[-1] = BOOL_VAL(tableDelete(&instance->fields, name));
+		return true;
+	}
+
+	if (argCount == 2 && IS_MAP(args[0]))
+	{
+		args[-1] = BOOL_VAL(valueTableDelete(&AS_MAP(args[0])->table, args[1]));
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to delete", 27));
+	return false;
+}
+
+static bool isNative(int argCount, Value * args)
+{
+	if (argCount == 2 && IS_INSTANCE(args[0]) && IS_CLASS(args[1]))
+	{
+		ObjInstance* instance = AS_INSTANCE(args[0]);
+		ObjClass* klass = AS_CLASS(args[1]);
+		args[-1] = BOOL_VAL(instance->klass == klass);
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to is", 23));
+	return false;
+}
+
+static bool mapNative(int argCount, Value * args)
+{
+	if (argCount == 0)
+	{
+		args[-1] = OBJ_VAL(newMap());
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to Map", 24));
+	return false;
+}
+
+static bool setNative(int argCount, Value * args)
+{
+	// Key and value are still on the stack, so they're safe if the table grows
+
+	if (argCount == 3 && IS_INSTANCE(args[0]) && IS_STRING(args[1]))
+	{
+		// Interning can hand back a different string, which then needs the stack slot to stay alive
+
+		args[1] = OBJ_VAL(internString(AS_STRING(args[1])));
+		tableSet(&AS_INSTANCE(args[0])->fields, AS_STRING(args[1]), args[2]);
+		args[-1] = args[2];
+		return true;
+	}
+
+	if (argCount == 3 && IS_MAP(args[0]))
+	{
+		valueTableSet(&AS_MAP(args[0])->table, args[1], args[2]);
+		args[-1] = args[2];
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to set", 24));
+	return false;
+}
+
+static bool hasNative(int argCount, Value * args)
+{
+	Value value;
+
+	if (argCount == 2 && IS_INSTANCE(args[0]) && IS_STRING(args[1]))
+	{
+		args[-1] = BOOL_VAL(tableGet(&AS_INSTANCE(args[0])->fields, internString(AS_STRING(args[1])), &value));
+		return true;
+	}
+
+	if (argCount == 2 && IS_MAP(args[0]))
+	{
+		args[-1] = BOOL_VAL(valueTableGet(&AS_MAP(args[0])->table, args[1], &value));
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to has", 24));
+	return false;
+}
+
+static bool sizeNative(int argCount, Value * args)
+{
+	if (argCount == 1 && IS_MAP(args[0]))
+	{
+		args[-1] = INT_VAL(AS_MAP(args[0])->table.count);
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to size", 25));
+	return false;
+}
+
+// Maps are iterated with a cursor, which is the slot of an entry in the map's table:
+//
+//   for (var i = next(map, nil); i != nil; i = next(map, i)) print keyAt(map, i);
+//
+// Entries can be deleted while iterating, but adding new keys may reorder them. The order
+//  depends on the hash seed (see HASH_SEED), so it's unspecified and can differ between runs.
+
+static bool isMapSlot(ValueTable * vtable, Value cursor)
+{
+	if (!IS_NUMBER(cursor))
+		return false;
+
+	double num = AS_NUMBER(cursor);
+
+	// Range check before the cast, converting NaN or an out of range double to int is undefined
+
+	return num >= 0 && num <= vtable->capacityMask && num == (int)num;
+}
+
+static bool isMapCursor(ValueTable * vtable, Value cursor)
+{
+	return isMapSlot(vtable, cursor) && valueTableNext(vtable, (int)AS_NUMBER(cursor)) == (int)AS_NUMBER(cursor);
+}
+
+static bool nextNative(int argCount, Value * args)
+{
+	// The cursor's entry may have been deleted since it was returned, so only its slot is checked
+
+	if (argCount == 2 && IS_MAP(args[0]) && (IS_NIL(args[1]) || isMapSlot(&AS_MAP(args[0])->table, args[1])))
+	{
+		int iSlot = IS_NIL(args[1]) ? 0 : (int)AS_NUMBER(args[1]) + 1;
+		iSlot = valueTableNext(&AS_MAP(args[0])->table, iSlot);
+		args[-1] = (iSlot < 0) ? NIL_VAL : INT_VAL(iSlot);
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to next", 25));
+	return false;
+}
+
+static bool keyAtNative(int argCount, Value * args)
+{
+	if (argCount == 2 && IS_MAP(args[0]) && isMapCursor(&AS_MAP(args[0])->table, args[1]))
+	{
+		args[-1] = AS_MAP(args[0])->table.aKeys[(int)AS_NUMBER(args[1])];
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to keyAt", 26));
+	return false;
+}
+
+static bool valueAtNative(int argCount, Value * args)
+{
+	if (argCount == 2 && IS_MAP(args[0]) && isMapCursor(&AS_MAP(args[0])->table, args[1]))
+	{
+		args[-1] = AS_MAP(args[0])->table.aValues[(int)AS_NUMBER(args[1])];
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to valueAt", 28));
+	return false;
+}
+
+static bool pushNative(int argCount, Value * args)
+{
+	// The pushed values stay on the stack until the call returns, so growing the
+	//  list can't collect them
+
+	if (argCount >= 1 && IS_LIST(args[0]))
+	{
+		ObjList * list = AS_LIST(args[0]);
+
+		for (int iArg = 1; iArg < argCount; ++iArg)
+		{
+			ARY_PUSH(list->aryValue, args[iArg]);
+		}
+
+		args[-1] = INT64_VAL(ARY_LEN(list->aryValue));
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to push", 25));
+	return false;
+}
+
+static bool popNative(int argCount, Value * args)
+{
+	if (argCount == 1 && IS_LIST(args[0]))
+	{
+		ObjList * list = AS_LIST(args[0]);
+
+		if (ARY_EMPTY(list->aryValue))
+		{
+			args[-1] = NIL_VAL;
+		}
+		else
+		{
+			args[-1] = *ARY_TAIL(list->aryValue);
+			ARY_POP(list->aryValue);
+		}
+
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to pop", 24));
+	return false;
+}
+
+static bool lengthNative(int argCount, Value * args)
+{
+	if (argCount == 1 && IS_LIST(args[0]))
+	{
+		args[-1] = INT64_VAL(ARY_LEN(AS_LIST(args[0])->aryValue));
+		return true;
+	}
+
+	if (argCount == 1 && IS_STRING(args[0]))
+	{
+		args[-1] = INT_VAL(AS_STRING(args[0])->length);
+		return true;
+	}
+
+	if (argCount == 1 && IS_MAP(args[0]))
+	{
+		args[-1] = INT_VAL(AS_MAP(args[0])->table.count);
+		return true;
+	}
+
+	if (argCount == 1 && IS_F64ARRAY(args[0]))
+	{
+		args[-1] = INT64_VAL(AS_F64ARRAY(args[0])->count);
+		return true;
+	}
+
+	if (argCount == 1 && IS_STRING_BUILDER(args[0]))
+	{
+		args[-1] = INT64_VAL(ARY_LEN(AS_STRING_BUILDER(args[0])->aryCh));
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to length", 27));
+	return false;
+}
+
+static bool isInteger(Value value)
+{
+	if (IS_INT(value))
+		return true;
+
+	// Range check first, converting anything outside int64_t is undefined
+
+	if (!IS_NUMBER(value))
+		return false;
+
+	double num = AS_NUMBER(value);
+
+	return num >= -9007199254740992.0 && num <= 9007199254740992.0 && num == (double)(int64_t)num;
+}
+
+static bool isIndexInRange(Value index, uint32_t count, uint32_t * pI)
+{
+	if (LIKELY(IS_INT(index)))
+	{
+		*pI = (uint32_t)AS_INT(index);
+		return AS_INT(index) >= 0 && *pI < count;
+	}
+
+	if (!isInteger(index) || AS_NUMBER(index) < 0 || AS_NUMBER(index) >= count)
+		return false;
+
+	*pI = (uint32_t)AS_NUMBER(index);
+	return true;
+}
+
+static int64_t sliceBound(Value bound, int64_t len)
+{
+	// Negative bounds count back from the end, anything out of range is clamped
+
+	int64_t i = (int64_t)AS_NUMBER(bound);
+
+	if (i < 0)
+	{
+		i += len;
+	}
+
+	return (i < 0) ? 0 : (i > len) ? len : i;
+}
+
+static bool sliceNative(int argCount, Value * args)
+{
+	if ((argCount == 2 || argCount == 3) && IS_LIST(args[0]) && isInteger(args[1]) && (argCount == 2 || isInteger(args[2])))
+	{
+		int64_t len = ARY_LEN(AS_LIST(args[0])->aryValue);
+		int64_t iStart = sliceBound(args[1], len);
+		int64_t iEnd = (argCount == 2) ? len : sliceBound(args[2], len);
+
+		// Root the new list in the callee's slot before filling it
+
+		ObjList * slice = newList();
+		args[-1] = OBJ_VAL(slice);
+
+		for (int64_t i = iStart; i < iEnd; ++i)
+		{
+			ARY_PUSH(slice->aryValue, AS_LIST(args[0])->aryValue[i]);
+		}
+
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to slice", 26));
+	return false;
+}
+
+static bool numberLess(Value a, Value b)
+{
+	// NaN sorts after everything else so the order stays strict weak
+
+	double numA = AS_NUMBER(a);
+	double numB = AS_NUMBER(b);
+
+	return numA < numB || (numB != numB && numA == numA);
+}
+
+static bool stringLess(Value a, Value b)
+{
+	ObjString * strA = AS_STRING(a);
+	ObjString * strB = AS_STRING(b);
+
+	int cCh = (strA->length < strB->length) ? strA->length : strB->length;
+	int cmp = memcmp(strA->aChars, strB->aChars, cCh);
+
+	return cmp < 0 || (cmp == 0 && strA->length < strB->length);
+}
+
+static bool sortNative(int argCount, Value * args)
+{
+	// Lists of all numbers or all strings only, there's no ordering between other values
+
+	if (argCount == 1 && IS_LIST(args[0]))
+	{
+		ObjList * list = AS_LIST(args[0]);
+		uint32_t cValue = ARY_LEN(list->aryValue);
+
+		bool fAllNumbers = true;
+		bool fAllStrings = true;
+
+		for (uint32_t iValue = 0; iValue < cValue; ++iValue)
+		{
+			fAllNumbers = fAllNumbers && IS_NUMBER(list->aryValue[iValue]);
+			fAllStrings = fAllStrings && IS_STRING(list->aryValue[iValue]);
+		}
+
+		if (fAllNumbers || fAllStrings)
+		{
+			sortValues(list->aryValue, cValue, (fAllNumbers) ? numberLess : stringLess);
+			args[-1] = args[0];
+			return true;
+		}
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to sort", 25));
+	return false;
+}
+
+// F64Array natives. Arrays passed together must be the same length, kernels that write to an
+//  array take it first and return it.
+
+static bool areF64Arrays(Value * aValue, int cValue)
+{
+	for (int iValue = 0; iValue < cValue; ++iValue)
+	{
+		if (!IS_F64ARRAY(aValue[iValue]) || AS_F64ARRAY(aValue[iValue])->count != AS_F64ARRAY(aValue[0])->count)
+			return false;
+	}
+
+	return true;
+}
+
+static bool isNumberList(ObjList * list)
+{
+	for (uint32_t iValue = 0; iValue < ARY_LEN(list->aryValue); ++iValue)
+	{
+		if (!IS_NUMBER(list->aryValue[iValue]))
+			return false;
+	}
+
+	return true;
+}
+
+static bool f64ArrayNative(int argCount, Value * args)
+{
+	if (argCount == 1 && isInteger(args[0]) && AS_NUMBER(args[0]) >= 0 && AS_NUMBER(args[0]) <= UINT32_MAX)
+	{
+		args[-1] = OBJ_VAL(newF64Array((uint32_t)AS_NUMBER(args[0])));
+		return true;
+	}
+
+	if (argCount == 1 && IS_LIST(args[0]) && isNumberList(AS_LIST(args[0])))
+	{
+		uint32_t cValue = ARY_LEN(AS_LIST(args[0])->aryValue);
+		ObjF64Array * f64a = newF64Array(cValue);
+		Value * aryValue = AS_LIST(args[0])->aryValue;
+
+		for (uint32_t iValue = 0; iValue < cValue; ++iValue)
+		{
+			f64a->aF64[iValue] = AS_NUMBER(aryValue[iValue]);
+		}
+
+		args[-1] = OBJ_VAL(f64a);
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to F64Array", 29));
+	return false;
+}
+
+static bool f64AddNative(int argCount, Value * args)
+{
+	if (argCount == 3 && areF64Arrays(args, 3))
+	{
+		ObjF64Array * dst = AS_F64ARRAY(args[0]);
+		getF64Kernels()->add(dst->aF64, AS_F64ARRAY(args[1])->aF64, AS_F64ARRAY(args[2])->aF64, dst->count);
+		args[-1] = args[0];
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to f64Add", 27));
+	return false;
+}
+
+static bool f64MulNative(int argCount, Value * args)
+{
+	if (argCount == 3 && areF64Arrays(args, 3))
+	{
+		ObjF64Array * dst = AS_F64ARRAY(args[0]);
+		getF64Kernels()->mul(dst->aF64, AS_F64ARRAY(args[1])->aF64, AS_F64ARRAY(args[2])->aF64, dst->count);
+		args[-1] = args[0];
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to f64Mul", 27));
+	return false;
+}
+
+static bool f64AxpyNative(int argCount, Value * args)
+{
+	// f64Axpy(y, alpha, x) is y += alpha * x
+
+	if (argCount == 3 && IS_NUMBER(args[1]) && IS_F64ARRAY(args[0]) && IS_F64ARRAY(args[2]) &&
+		AS_F64ARRAY(args[0])->count == AS_F64ARRAY(args[2])->count)
+	{
+		ObjF64Array * y = AS_F64ARRAY(args[0]);
+		getF64Kernels()->axpy(y->aF64, AS_NUMBER(args[1]), AS_F64ARRAY(args[2])->aF64, y->count);
+		args[-1] = args[0];
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to f64Axpy", 28));
+	return false;
+}
+
+static bool f64ScaleNative(int argCount, Value * args)
+{
+	// f64Scale(dst, a, mul, add = 0) is dst = a * mul + add
+
+	if ((argCount == 3 || argCount == 4) && areF64Arrays(args, 2) && IS_NUMBER(args[2]) && (argCount == 3 || IS_NUMBER(args[3])))
+	{
+		ObjF64Array * dst = AS_F64ARRAY(args[0]);
+		double add = (argCount == 3) ? 0.0 : AS_NUMBER(args[3]);
+		getF64Kernels()->scale(dst->aF64, AS_F64ARRAY(args[1])->aF64, AS_NUMBER(args[2]), add, dst->count);
+		args[-1] = args[0];
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to f64Scale", 29));
+	return false;
+}
+
+static bool f64FillNative(int argCount, Value * args)
+{
+	if (argCount == 2 && IS_F64ARRAY(args[0]) && IS_NUMBER(args[1]))
+	{
+		ObjF64Array * dst = AS_F64ARRAY(args[0]);
+		getF64Kernels()->fill(dst->aF64, AS_NUMBER(args[1]), dst->count);
+		args[-1] = args[0];
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to f64Fill", 28));
+	return false;
+}
+
+static bool f64PrefixSumNative(int argCount, Value * args)
+{
+	if (argCount == 2 && areF64Arrays(args, 2))
+	{
+		ObjF64Array * dst = AS_F64ARRAY(args[0]);
+		getF64Kernels()->prefixSum(dst->aF64, AS_F64ARRAY(args[1])->aF64, dst->count);
+		args[-1] = args[0];
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to f64PrefixSum", 33));
+	return false;
+}
+
+static bool f64SumNative(int argCount, Value * args)
+{
+	if (argCount == 1 && IS_F64ARRAY(args[0]))
+	{
+		ObjF64Array * f64a = AS_F64ARRAY(args[0]);
+		args[-1] = NUMBER_VAL(getF64Kernels()->sum(f64a->aF64, f64a->count));
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to f64Sum", 27));
+	return false;
+}
+
+static bool f64DotNative(int argCount, Value * args)
+{
+	if (argCount == 2 && areF64Arrays(args, 2))
+	{
+		ObjF64Array * a = AS_F64ARRAY(args[0]);
+		args[-1] = NUMBER_VAL(getF64Kernels()->dot(a->aF64, AS_F64ARRAY(args[1])->aF64, a->count));
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to f64Dot", 27));
+	return false;
+}
+
+static bool f64MinNative(int argCount, Value * args)
+{
+	// nil if there are no elements
+
+	if (argCount == 1 && IS_F64ARRAY(args[0]))
+	{
+		ObjF64Array * f64a = AS_F64ARRAY(args[0]);
+		args[-1] = (f64a->count == 0) ? NIL_VAL : NUMBER_VAL(getF64Kernels()->min(f64a->aF64, f64a->count));
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to f64Min", 27));
+	return false;
+}
+
+static bool f64MaxNative(int argCount, Value * args)
+{
+	if (argCount == 1 && IS_F64ARRAY(args[0]))
+	{
+		ObjF64Array * f64a = AS_F64ARRAY(args[0]);
+		args[-1] = (f64a->count == 0) ? NIL_VAL : NUMBER_VAL(getF64Kernels()->max(f64a->aF64, f64a->count));
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to f64Max", 27));
+	return false;
+}
+
+// Building a string with + copies every intermediate result. A StringBuilder appends in
+//  place and only copies once, in toString:
+//
+//   var sb = StringBuilder();
+//   for (var i = 0; i < 10; i = i + 1) append(sb, i, ", ");
+//   print toString(sb);
+
+static bool stringBuilderNative(int argCount, Value * args)
+{
+	if (argCount == 0)
+	{
+		args[-1] = OBJ_VAL(newStringBuilder());
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to StringBuilder", 34));
+	return false;
+}
+
+static bool appendNative(int argCount, Value * args)
+{
+	// Strings, numbers, bools and nil append the same text print would show
+
+	if (argCount >= 1 && IS_STRING_BUILDER(args[0]))
+	{
+		ObjStringBuilder * sb = AS_STRING_BUILDER(args[0]);
+
+		for (int iArg = 1; iArg < argCount; ++iArg)
+		{
+			Value value = args[iArg];
+
+			if (IS_STRING(value))
+			{
+				ARY_APPEND(sb->aryCh, AS_STRING(value)->aChars, (uint32_t)AS_STRING(value)->length);
+			}
+			else if (IS_NUMBER(value))
+			{
+				char aCh[NUMBER_FORMAT_MAX];
+				int cCh = formatNumber(AS_NUMBER(value), aCh, sizeof(aCh));
+				ARY_APPEND(sb->aryCh, aCh, (uint32_t)cCh);
+			}
+			else if (IS_BOOL(value))
+			{
+				if (AS_BOOL(value))
+				{
+					ARY_APPEND(sb->aryCh, "true", 4);
+				}
+				else
+				{
+					ARY_APPEND(sb->aryCh, "false", 5);
+				}
+			}
+			else if (IS_NIL(value))
+			{
+				ARY_APPEND(sb->aryCh, "nil", 3);
+			}
+			else
+			{
+				args[-1] = OBJ_VAL(copyString("Invalid arguments to append", 27));
+				return false;
+			}
+		}
+
+		args[-1] = args[0];
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to append", 27));
+	return false;
+}
+
+static bool toStringNative(int argCount, Value * args)
+{
+	if (argCount == 1 && IS_STRING_BUILDER(args[0]))
+	{
+		ObjStringBuilder * sb = AS_STRING_BUILDER(args[0]);
+		args[-1] = OBJ_VAL(copyStringTransient((sb->aryCh) ? sb->aryCh : "", (int)ARY_LEN(sb->aryCh)));
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to toString", 29));
+	return false;
+}
+
+// Substrings are slices that share the original string's characters, see sliceString
+
+static ObjString * substring(ObjString * str, Value start, Value end)
+{
+	// Bounds are integers, end may be nil for the rest of the string
+
+	int64_t iStart = sliceBound(start, str->length);
+	int64_t iEnd = IS_NIL(end) ? str->length : sliceBound(end, str->length);
+
+	if (iEnd < iStart)
+	{
+		iEnd = iStart;
+	}
+
+	return sliceString(str, (int)iStart, (int)(iEnd - iStart));
+}
+
+static void splitString(ObjString * str, ObjString * sep, Value * pResult)
+{
+	// str must be rooted. The list goes into pResult, which must be a stack slot, before it grows.
+
+	ASSERT(sep->length > 0);
+
+	ObjList * list = newList();
+	*pResult = OBJ_VAL(list);
+
+	int iStart = 0;
+	int iCh = 0;
+
+	while (iCh + sep->length <= str->length)
+	{
+		if (memcmp(&str->aChars[iCh], sep->aChars, sep->length) != 0)
+		{
+			iCh++;
+			continue;
+		}
+
+		// Each piece stays on the stack while the list grows
+
+		push(OBJ_VAL(sliceString(str, iStart, iCh - iStart)));
+		ARY_PUSH(list->aryValue, peek(0));
+		pop();
+
+		iCh += sep->length;
+		iStart = iCh;
+	}
+
+	push(OBJ_VAL(sliceString(str, iStart, str->length - iStart)));
+	ARY_PUSH(list->aryValue, peek(0));
+	pop();
+}
+
+static bool substringNative(int argCount, Value * args)
+{
+	// Bounds work like slice on lists
+
+	if ((argCount == 2 || argCount == 3) && IS_STRING(args[0]) && isInteger(args[1]) && (argCount == 2 || isInteger(args[2])))
+	{
+		args[-1] = OBJ_VAL(substring(AS_STRING(args[0]), args[1], (argCount == 2) ? NIL_VAL : args[2]));
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to substring", 30));
+	return false;
+}
+
+static bool splitNative(int argCount, Value * args)
+{
+	if (argCount == 2 && IS_STRING(args[0]) && IS_STRING(args[1]) && AS_STRING(args[1])->length > 0)
+	{
+		splitString(AS_STRING(args[0]), AS_STRING(args[1]), &args[-1]);
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to split", 26));
+	return false;
+}
+
+static bool weakMapNative(int argCount, Value * args)
+{
+	if (argCount == 0)
+	{
+		args[-1] = OBJ_VAL(newWeakMap());
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to WeakMap", 28));
+	return false;
+}
+
+static bool weakRefNative(int argCount, Value * args)
+{
+	// Strings are left out for the same reason weak maps hold them strongly
+
+	if (argCount == 1 && IS_OBJ(args[0]) && !IS_STRING(args[0]))
+	{
+		args[-1] = OBJ_VAL(newWeakRef(AS_OBJ(args[0])));
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to WeakRef", 28));
+	return false;
+}
+
+static bool derefNative(int argCount, Value * args)
+{
+	if (argCount == 1 && IS_WEAK_REF(args[0]))
+	{
+		Obj * target = AS_WEAK_REF(args[0])->target;
+		args[-1] = (target == NULL) ? NIL_VAL : OBJ_VAL(target);
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to deref", 26));
+	return false;
+}
+
+static bool gcNative(int argCount, Value * args)
+{
+	if (argCount == 0)
+	{
+		collectGarbage();
+		args[-1] = NIL_VAL;
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to gc", 23));
+	return false;
+}
+
+static bool memoizeNative(int argCount, Value * args)
+{
+	// memoize(fn) or memoize(fn, maxEntries), least recently used results are dropped past the cap
+
+	if ((argCount == 1 || argCount == 2) && IS_CLOSURE(args[0]))
+	{
+		if (argCount == 1)
+		{
+			args[-1] = OBJ_VAL(newMemo(AS_CLOSURE(args[0]), 0));
+			return true;
+		}
+
+		if (isInteger(args[1]) && AS_NUMBER(args[1]) >= 1 && AS_NUMBER(args[1]) <= INT32_MAX)
+		{
+			args[-1] = OBJ_VAL(newMemo(AS_CLOSURE(args[0]), (uint32_t)AS_NUMBER(args[1])));
+			return true;
+		}
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to memoize", 28));
+	return false;
+}
+
+static bool jsonParseNative(int argCount, Value * args)
+{
+	// Objects become maps, arrays become lists, null becomes nil
+
+	if (argCount == 1 && IS_STRING(args[0]))
+	{
+		ObjString * str = AS_STRING(args[0]);
+		char aChErr[128];
+
+		if (!parseJson(str->aChars, str->length, aChErr, sizeof(aChErr)))
+		{
+			args[-1] = OBJ_VAL(copyString(aChErr, (int)strlen(aChErr)));
+			return false;
+		}
+
+		args[-1] = pop();
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to jsonParse", 30));
+	return false;
+}
+
+static bool jsonStringifyNative(int argCount, Value * args)
+{
+	if (argCount == 1)
+	{
+		char * aryCh = NULL;
+		const char * err = writeJson(args[0], &aryCh);
+
+		if (err != NULL)
+		{
+			ARY_FREE(aryCh);
+			args[-1] = OBJ_VAL(copyString(err, (int)strlen(err)));
+			return false;
+		}
+
+		args[-1] = OBJ_VAL(copyStringTransient(aryCh, (int)ARY_LEN(aryCh)));
+		ARY_FREE(aryCh);
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to jsonStringify", 34));
+	return false;
+}
+
+// Methods of the String class. The receiver is in args[-1], which is also where the result goes.
+//  Subclasses inherit these, so the receiver isn't necessarily a string.
+
+static bool stringLengthMethod(int argCount, Value * args)
+{
+	if (argCount == 0 && IS_STRING(args[-1]))
+	{
+		args[-1] = INT_VAL(AS_STRING(args[-1])->length);
+		return true;
+	}
+
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to String.length", 34));
+	return false;
+}
+
+static int findSubstring(const ObjString * str, const ObjString * needle, int iStart)
 {
-	// A null name indicates the root "function" (the script itself)
+	if (needle->length == 0)
+		return iStart;
 
-	ASSERT(function);
-	ASSERT(function->name == NULL);
+	// memchr skips ahead to candidates a vector at a time, only those get compared in full
 
-	push(OBJ_VAL(function));
-	ObjClosure * closure = newClosure(function);
-	pop();
-	push(OBJ_VAL(closure));
-	callValue(OBJ_VAL(closure), 0);
+	const char * pCh = str->aChars + iStart;
+	const char * pChLast = str->aChars + str->length - needle->length;
 
-	return run();
-}
+	while (pCh <= pChLast)
+	{
+		pCh = memchr(pCh, needle->aChars[0], pChLast - pCh + 1);
 
-static void resetStack(void)
-{
-	vm.stackTop = vm.stack;
-	vm.frameCount = 0;
-}
+		if (pCh == NULL)
+			break;
 
-static bool clockNative(int argCount, Value * args)
-{
-	UNUSED(argCount);
-	args[-1] = NUMBER_VAL((double)clock() / CLOCKS_PER_SEC);
-	return true;
+		if (memcmp(pCh + 1, needle->aChars + 1, needle->length - 1) == 0)
+			return (int)(pCh - str->aChars);
+
+		pCh++;
+	}
+
+	return -1;
 }
 
-static bool errNative(int argCount, Value * args)
+static bool stringIndexOfMethod(int argCount, Value * args)
 {
-	if (argCount > 0 && IS_STRING(args[0]))
-	{
-		args[-1] = args[0];
-	}
-	else
+	// indexOf(needle[, start]), -1 if not found
+
+	if ((argCount == 1 || argCount == 2) && IS_STRING(args[-1]) && IS_STRING(args[0]) && (argCount == 1 || isInteger(args[1])))
 	{
-		args[-1] = OBJ_VAL(copyString("Runtime Error", 13));
+		ObjString * str = AS_STRING(args[-1]);
+		int iStart = (argCount == 1) ? 0 : (int)sliceBound(args[1], str->length);
+
+		args[-1] = INT_VAL(findSubstring(str, AS_STRING(args[0]), iStart));
+		return true;
 	}
 
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to String.indexOf", 35));
 	return false;
 }
 
-static bool getNative(int argCount, Value * args)
+static bool stringSliceMethod(int argCount, Value * args)
 {
-	if ((argCount == 2 || argCount == 3) && IS_INSTANCE(args[0]) && IS_STRING(args[1]))
+	// slice(start[, end]), same bounds as substring
+
+	if ((argCount == 1 || argCount == 2) && IS_STRING(args[-1]) && isInteger(args[0]) && (argCount == 1 || isInteger(args[1])))
 	{
-		ObjInstance* instance = AS_INSTANCE(args[0]);
-		ObjString* name = AS_STRING(args[1]);
-		Value value;
-		if (!tableGet(&instance->fields, name, &value)) value = (argCount == 2) ? NIL_VAL : args[2];
-		args[-1] = value;
+		args[-1] = OBJ_VAL(substring(AS_STRING(args[-1]), args[0], (argCount == 1) ? NIL_VAL : args[1]));
 		return true;
 	}
 
-	args[-1] = OBJ_VAL(copyString("Invalid arguments to get", 24));
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to String.slice", 33));
 	return false;
 }
 
-static bool deleteNative(int argCount, Value * args)
+static bool stringSplitMethod(int argCount, Value * args)
 {
-	if (argCount == 2 && IS_INSTANCE(args[0]) && IS_STRING(args[1]))
+	if (argCount == 1 && IS_STRING(args[-1]) && IS_STRING(args[0]) && AS_STRING(args[0])->length > 0)
 	{
-		ObjInstance* instance = AS_INSTANCE(args[0]);
-		ObjString* name = AS_STRING(args[1]);
-		args[-1] = BOOL_VAL(tableDelete(&instance->fields, name));
+		// The result replaces the receiver, so keep the receiver on the stack until it's done
+
+		push(args[-1]);
+		splitString(AS_STRING(peek(0)), AS_STRING(args[0]), &args[-1]);
+		pop();
+
 		return true;
 	}
 
-	args[-1] = OBJ_VAL(copyString("Invalid arguments to delete", 27));
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to String.split", 33));
 	return false;
 }
 
-static bool isNative(int argCount, Value * args)
+static bool stringToNumberMethod(int argCount, Value * args)
 {
-	if (argCount == 2 && IS_INSTANCE(args[0]) && IS_CLASS(args[1]))
+	// nil unless the whole string is a number, as scanNumber reads them
+
+	if (argCount == 0 && IS_STRING(args[-1]))
 	{
-		ObjInstance* instance = AS_INSTANCE(args[0]);
-		ObjClass* klass = AS_CLASS(args[1]);
-		args[-1] = BOOL_VAL(instance->klass == klass);
+		ObjString * str = AS_STRING(args[-1]);
+		args[-1] = NIL_VAL;
+
+		bool isInteger;
+		int cCh = scanNumber(str->aChars, str->aChars + str->length, &isInteger);
+
+		if (cCh > 0 && cCh == str->length)
+		{
+			double num = (isInteger) ? parseInteger(str->aChars, cCh) : parseNumber(str->aChars, cCh);
+			args[-1] = NUMBER_VAL_NARROW(num);
+		}
+
 		return true;
 	}
 
-	args[-1] = OBJ_VAL(copyString("Invalid arguments to is", 23));
+	args[-1] = OBJ_VAL(copyString("Invalid arguments to String.toNumber", 36));
 	return false;
 }
 
 static void runtimeError(const char * format, ...)
 {
+	flushOutput();
+
 	fputs("ERROR: ", stderr);
 
 	va_list args;
@@ -239,7 +1295,7 @@ static void runtimeError(const char * format, ...)
 		}
 		else
 		{
-			fprintf(stderr, "%s()\n", function->name->aChars);
+			fprintf(stderr, "%.*s()\n", function->name->length, function->name->aChars);
 		}
 	}
 
@@ -255,6 +1311,38 @@ static void defineNative(const char * name, NativeFn function)
 	pop();
 }
 
+static ObjClass * defineNativeClass(const char * name)
+{
+	// A global class whose methods are natives, see defineNativeMethod. Scripts can subclass it
+	//  like any other class.
+
+	push(OBJ_VAL(copyString(name, (int)strlen(name))));
+	push(OBJ_VAL(newClass(AS_STRING(peek(0)))));
+	tableSet(&vm.globals, AS_STRING(peek(1)), peek(0));
+	ObjClass * klass = AS_CLASS(pop());
+	pop();
+
+	return klass;
+}
+
+static void defineNativeMethod(ObjClass * klass, const char * name, NativeFn function)
+{
+	// Called with the receiver in args[-1], see stringLengthMethod. klass must be rooted.
+
+	push(OBJ_VAL(copyString(name, (int)strlen(name))));
+	push(OBJ_VAL(newNative(function)));
+	tableSet(&klass->methods, AS_STRING(peek(1)), peek(0));
+	pop();
+	pop();
+}
+
+static ObjClass * builtinClassOf(Value value)
+{
+	// Class whose methods values that aren't instances get, NULL if there isn't one
+
+	return IS_STRING(value) ? vm.stringClass : NULL;
+}
+
 static bool call(ObjClosure * closure, int argCount)
 {
 	if (argCount != closure->function->arity)
@@ -269,14 +1357,82 @@ static bool call(ObjClosure * closure, int argCount)
 		return false;
 	}
 
+	if (UNLIKELY(closure->function->lazy != NULL) && !compileLazyFunction(closure->function))
+	{
+		runtimeError("Could not compile function '%.*s'.", closure->function->name->length, closure->function->name->aChars);
+		return false;
+	}
+
 	CallFrame * frame = &vm.frames[vm.frameCount++];
 	frame->closure = closure;
 	frame->ip = closure->function->chunk.aryB;
 	frame->slots = vm.stackTop - argCount - 1;
+	frame->memo = NULL;
+
+	return true;
+}
+
+static bool callMemo(ObjMemo * memo, int argCount)
+{
+	MemoCache * memoc = &memo->cache;
+
+	// Wrong arity falls through to call, which reports it
+
+	if (argCount != memoc->arity)
+		return call(memo->closure, argCount);
+
+	Value * aArg = vm.stackTop - argCount;
+	uint32_t hash = hashMemoArgs(aArg, argCount);
+	Value result;
+
+	if (memoCacheGet(memoc, aArg, hash, &result))
+	{
+		vm.stackTop -= argCount;
+		vm.stackTop[-1] = result;
+		return true;
+	}
+
+	// The body may reassign its parameters, so the key is copied now. The memo is in the
+	//  callee's slot, which keeps it and the copy alive until the call returns.
+
+	uint32_t iArgPending = ARY_LEN(memoc->aryArgPending);
+	ARY_APPEND(memoc->aryArgPending, aArg, argCount);
+
+	if (!call(memo->closure, argCount))
+	{
+		// The error already unwound any memoized frames below us, which may have dropped our arguments too
+
+		if (ARY_LEN(memoc->aryArgPending) > iArgPending)
+		{
+			ARY_TRUNCATE(memoc->aryArgPending, iArgPending);
+		}
+
+		return false;
+	}
+
+	CallFrame * frame = &vm.frames[vm.frameCount - 1];
+	frame->memo = memo;
+	frame->iArgPending = iArgPending;
 
 	return true;
 }
 
+static void returnMemo(ObjMemo * memo, uint32_t iArgPending, Value result)
+{
+	// Result has to be rooted by the caller, adding it may grow the cache
+
+	MemoCache * memoc = &memo->cache;
+	Value * aArg = memoc->aryArgPending + iArgPending;
+
+	memoCacheSet(memoc, aArg, hashMemoArgs(aArg, memoc->arity), result);
+
+	// Calls return in the reverse order they were made, and resetStack drops the arguments of any
+	//  that never will, so ours are always the last ones pending
+
+	ASSERT(iArgPending + memoc->arity == ARY_LEN(memoc->aryArgPending));
+	ARY_TRUNCATE(memoc->aryArgPending, iArgPending);
+}
+
 static bool callValue(Value callee, int argCount)
 {
 	if (IS_OBJ(callee))
@@ -286,11 +1442,18 @@ static bool callValue(Value callee, int argCount)
 			case OBJ_CLOSURE:
 				return call(AS_CLOSURE(callee), argCount);
 
+			case OBJ_MEMO:
+				return callMemo(AS_MEMO(callee), argCount);
+
 			case OBJ_BOUND_METHOD:
 			{
 				ObjBoundMethod* bound = AS_BOUND_METHOD(callee);
 				vm.stackTop[-argCount - 1] = bound->receiver;
-				return call(bound->method, argCount);
+
+				if (LIKELY(getObjType(bound->method) == OBJ_CLOSURE))
+					return call((ObjClosure*)bound->method, argCount);
+
+				return callValue(OBJ_VAL(bound->method), argCount);
 			}
 
 			case OBJ_NATIVE:
@@ -306,7 +1469,8 @@ static bool callValue(Value callee, int argCount)
 				{
 					// BB (matthewp) Relax this restriction
 					ASSERT(IS_STRING(vm.stackTop[-argCount - 1]));
-					runtimeError(AS_CSTRING(vm.stackTop[-argCount - 1]));
+					ObjString * message = AS_STRING(vm.stackTop[-argCount - 1]);
+					runtimeError("%.*s", message->length, message->aChars);
 					return false;
 				}
 			}
@@ -342,10 +1506,15 @@ static bool invokeFromClass(ObjClass* klass, ObjString* name, int argCount)
 	Value method;
 	if (!tableGet(&klass->methods, name, &method))
 	{
-		runtimeError("Undefined property '%s'.", name->aChars);
+		runtimeError("Undefined property '%.*s'.", name->length, name->aChars);
 		return false;
 	}
 
+	// Native methods find the receiver just before their arguments, no bound method needed
+
+	if (IS_NATIVE(method))
+		return callValue(method, argCount);
+
 	return call(AS_CLOSURE(method), argCount);
 }
 
@@ -355,8 +1524,15 @@ static bool invoke(ObjString* name, int argCount)
 
 	if (!IS_INSTANCE(receiver))
 	{
-		runtimeError("Only instances have methods.");
-		return false;
+		ObjClass * klass = builtinClassOf(receiver);
+
+		if (klass == NULL)
+		{
+			runtimeError("Only instances have methods.");
+			return false;
+		}
+
+		return invokeFromClass(klass, name, argCount);
 	}
 
 	ObjInstance* instance = AS_INSTANCE(receiver);
@@ -377,7 +1553,7 @@ static bool bindMethod(ObjClass* klass, ObjString* name)
 	if (!tableGet(&klass->methods, name, &method))
 		return false;
 
-	ObjBoundMethod* bound = newBoundMethod(peek(0), AS_CLOSURE(method));
+	ObjBoundMethod* bound = newBoundMethod(peek(0), AS_OBJ(method));
 	pop();
 	push(OBJ_VAL(bound));
 	return true;
@@ -468,6 +1644,26 @@ static InterpretResult run(void)
 		push(valueType(a op b)); \
 	} while(false)
 
+	// Both operands tagged ints. The exact result always fits in 64 bits, INT64_VAL turns it back
+	//  into a double when it doesn't fit in an int, the same double the FPU would have given.
+
+#define INT_BINARY_OP(op) \
+	do { \
+		int64_t b = AS_INT(pop()); \
+		int64_t a = AS_INT(peek(0)); \
+		vm.stackTop[-1] = INT64_VAL(a op b); \
+	} while(false)
+#define COMPARE_OP(op) \
+	do { \
+		if (LIKELY(IS_INT(peek(0)) && IS_INT(peek(1)))) { \
+			int32_t b = AS_INT(pop()); \
+			int32_t a = AS_INT(peek(0)); \
+			vm.stackTop[-1] = BOOL_VAL(a op b); \
+		} else { \
+			BINARY_OP(BOOL_VAL, op); \
+		} \
+	} while(false)
+
 	for (;;)
 	{
 #if DEBUG_TRACE_EXECUTION
@@ -541,7 +1737,7 @@ static InterpretResult run(void)
 				Value value;
 				if (!tableGet(&vm.globals, name, &value))
 				{
-					RETURN_RUNTIME_ERR("Undefined variable '%s'.", name->aChars);
+					RETURN_RUNTIME_ERR("Undefined variable '%.*s'.", name->length, name->aChars);
 				}
 				push(value);
 				break;
@@ -553,7 +1749,7 @@ static InterpretResult run(void)
 				ObjString * name = READ_STRING(op == OP_DEFINE_GLOBAL);
 				if (!tableSetIfNew(&vm.globals, name, peek(0)))
 				{
-					RETURN_RUNTIME_ERR("Global named '%s' already exists.", name->aChars);
+					RETURN_RUNTIME_ERR("Global named '%.*s' already exists.", name->length, name->aChars);
 				}
 				pop();
 				break;
@@ -566,7 +1762,7 @@ static InterpretResult run(void)
 				if (tableSet(&vm.globals, name, peek(0)))
 				{
 					tableDelete(&vm.globals, name);
-					RETURN_RUNTIME_ERR("Undefined variable '%s'.", name->aChars);
+					RETURN_RUNTIME_ERR("Undefined variable '%.*s'.", name->length, name->aChars);
 				}
 				break;
 			}
@@ -603,14 +1799,26 @@ static InterpretResult run(void)
 			case OP_GET_PROPERTY_LONG:
 			{
 				Value p = peek(0);
+				ObjString* name = READ_STRING(op == OP_GET_PROPERTY);
 
 				if (!IS_INSTANCE(p))
 				{
-					RETURN_RUNTIME_ERR("Trying to access a property on a non-instance object.");
+					ObjClass * klass = builtinClassOf(p);
+
+					if (klass == NULL)
+					{
+						RETURN_RUNTIME_ERR("Trying to access a property on a non-instance object.");
+					}
+
+					if (!bindMethod(klass, name))
+					{
+						RETURN_RUNTIME_ERR("Undefined property '%.*s'.", name->length, name->aChars);
+					}
+
+					break;
 				}
 
 				ObjInstance* instance = AS_INSTANCE(p);
-				ObjString* name = READ_STRING(op == OP_GET_PROPERTY);
 
 				Value value;
 				if (tableGet(&instance->fields, name, &value))
@@ -622,7 +1830,7 @@ static InterpretResult run(void)
 
 				if (!bindMethod(instance->klass, name))
 				{
-					RETURN_RUNTIME_ERR("Undefined property '%s'.", name->aChars);
+					RETURN_RUNTIME_ERR("Undefined property '%.*s'.", name->length, name->aChars);
 				}
 
 				break;
@@ -656,7 +1864,7 @@ static InterpretResult run(void)
 				ObjClass* superclass = AS_CLASS(pop());
 				if (!bindMethod(superclass, name))
 				{
-					RETURN_RUNTIME_ERR("Undefined method on '%s' superclass.", name->aChars);
+					RETURN_RUNTIME_ERR("Undefined method on '%.*s' superclass.", name->length, name->aChars);
 				}
 				break;
 			}
@@ -665,12 +1873,12 @@ static InterpretResult run(void)
 			{
 				Value b = pop();
 				Value a = pop();
-				push(BOOL_VAL(valuesEqual(a, b)));
+				push(BOOL_VAL((IS_INT(a) && IS_INT(b)) ? a == b : valuesEqual(a, b)));
 				break;
 			}
 
-			case OP_GREATER: BINARY_OP(BOOL_VAL, >); break;
-			case OP_LESS: BINARY_OP(BOOL_VAL, <); break;
+			case OP_GREATER: COMPARE_OP(>); break;
+			case OP_LESS: COMPARE_OP(<); break;
 
 			case OP_NEGATE:
 				if (!IS_NUMBER(peek(0)))
@@ -678,12 +1886,25 @@ static InterpretResult run(void)
 					RETURN_RUNTIME_ERR("Operand must be a number.");
 				}
 
-				push(NUMBER_VAL(-AS_NUMBER(pop())));
+				// -0 is a double, and so is -INT32_MIN
+
+				if (IS_INT(peek(0)) && AS_INT(peek(0)) != 0 && AS_INT(peek(0)) != INT32_MIN)
+				{
+					push(INT_VAL(-AS_INT(pop())));
+				}
+				else
+				{
+					push(NUMBER_VAL(-AS_NUMBER(pop())));
+				}
 				break;
 
 			case OP_ADD:
 			{
-				if (IS_STRING(peek(0)) && IS_STRING(peek(1)))
+				if (LIKELY(IS_INT(peek(0)) && IS_INT(peek(1))))
+				{
+					INT_BINARY_OP(+);
+				}
+				else if (IS_STRING(peek(0)) && IS_STRING(peek(1)))
 				{
 					concatenate();
 				}
@@ -699,8 +1920,36 @@ static InterpretResult run(void)
 				}
 				break;
 			}
-			case OP_SUBTRACT: BINARY_OP(NUMBER_VAL, -); break;
-			case OP_MULTIPLY: BINARY_OP(NUMBER_VAL, *); break;
+			case OP_SUBTRACT:
+			{
+				if (LIKELY(IS_INT(peek(0)) && IS_INT(peek(1))))
+				{
+					INT_BINARY_OP(-);
+				}
+				else
+				{
+					BINARY_OP(NUMBER_VAL, -);
+				}
+				break;
+			}
+
+			case OP_MULTIPLY:
+			{
+				// A zero product with a negative operand is -0, which only the double path gives
+
+				if (LIKELY(IS_INT(peek(0)) && IS_INT(peek(1)) &&
+					(AS_INT(peek(0)) != 0 || AS_INT(peek(1)) >= 0) &&
+					(AS_INT(peek(1)) != 0 || AS_INT(peek(0)) >= 0)))
+				{
+					INT_BINARY_OP(*);
+				}
+				else
+				{
+					BINARY_OP(NUMBER_VAL, *);
+				}
+				break;
+			}
+
 			case OP_DIVIDE: BINARY_OP(NUMBER_VAL, /); break;
 
 			case OP_NOT: push(BOOL_VAL(isFalsey(pop()))); break;
@@ -708,7 +1957,7 @@ static InterpretResult run(void)
 			case OP_PRINT:
 			{
 				printValue(pop());
-				printf("\n");
+				writeOutput("\n", 1);
 				break;
 			}
 
@@ -818,6 +2067,13 @@ static InterpretResult run(void)
 
 				closeUpvalues(frame->slots);
 
+				if (UNLIKELY(frame->memo != NULL))
+				{
+					push(result);
+					returnMemo(frame->memo, frame->iArgPending, result);
+					pop();
+				}
+
 				vm.frameCount--;
 				if (vm.frameCount == 0) return INTERPRET_OK;
 
@@ -852,6 +2108,144 @@ static InterpretResult run(void)
 			case OP_METHOD_LONG:
 				defineMethod(READ_STRING(op == OP_METHOD));
 				break;
+
+			case OP_LIST:
+			case OP_LIST_APPEND:
+			{
+				uint8_t cValue = READ_BYTE();
+				Value * aValue = vm.stackTop - cValue;
+				ObjList * list;
+
+				if (op == OP_LIST)
+				{
+					list = newList();
+					push(OBJ_VAL(list));
+				}
+				else
+				{
+					list = AS_LIST(aValue[-1]);
+				}
+
+				for (uint8_t iValue = 0; iValue < cValue; ++iValue)
+				{
+					ARY_PUSH(list->aryValue, aValue[iValue]);
+				}
+
+				vm.stackTop = aValue;
+
+				if (op == OP_LIST)
+				{
+					push(OBJ_VAL(list));
+				}
+
+				break;
+			}
+
+			case OP_INDEX_GET:
+			{
+				Value index = peek(0);
+				Value target = peek(1);
+				Value value;
+				uint32_t i;
+
+				if (IS_LIST(target))
+				{
+					ObjList * list = AS_LIST(target);
+
+					if (!isIndexInRange(index, ARY_LEN(list->aryValue), &i))
+					{
+						RETURN_RUNTIME_ERR("List index out of range.");
+					}
+
+					value = list->aryValue[i];
+				}
+				else if (IS_MAP(target))
+				{
+					if (!valueTableGet(&AS_MAP(target)->table, index, &value))
+					{
+						value = NIL_VAL;
+					}
+				}
+				else if (IS_F64ARRAY(target))
+				{
+					ObjF64Array * f64a = AS_F64ARRAY(target);
+
+					if (!isIndexInRange(index, f64a->count, &i))
+					{
+						RETURN_RUNTIME_ERR("F64Array index out of range.");
+					}
+
+					value = NUMBER_VAL(f64a->aF64[i]);
+				}
+				else if (IS_STRING(target))
+				{
+					ObjString * str = AS_STRING(target);
+
+					if (!isIndexInRange(index, str->length, &i))
+					{
+						RETURN_RUNTIME_ERR("String index out of range.");
+					}
+
+					value = OBJ_VAL(copyString(&str->aChars[i], 1));
+				}
+				else
+				{
+					RETURN_RUNTIME_ERR("Can only index lists, maps, F64Arrays and strings.");
+				}
+
+				pop();
+				pop();
+				push(value);
+				break;
+			}
+
+			case OP_INDEX_SET:
+			{
+				Value value = peek(0);
+				Value index = peek(1);
+				Value target = peek(2);
+				uint32_t i;
+
+				if (IS_LIST(target))
+				{
+					ObjList * list = AS_LIST(target);
+
+					if (!isIndexInRange(index, ARY_LEN(list->aryValue), &i))
+					{
+						RETURN_RUNTIME_ERR("List index out of range.");
+					}
+
+					list->aryValue[i] = value;
+				}
+				else if (IS_MAP(target))
+				{
+					valueTableSet(&AS_MAP(target)->table, index, value);
+				}
+				else if (IS_F64ARRAY(target))
+				{
+					ObjF64Array * f64a = AS_F64ARRAY(target);
+
+					if (!isIndexInRange(index, f64a->count, &i))
+					{
+						RETURN_RUNTIME_ERR("F64Array index out of range.");
+					}
+
+					if (!IS_NUMBER(value))
+					{
+						RETURN_RUNTIME_ERR("F64Array elements must be numbers.");
+					}
+
+					f64a->aF64[i] = AS_NUMBER(value);
+				}
+				else
+				{
+					RETURN_RUNTIME_ERR("Can only assign into lists, maps and F64Arrays.");
+				}
+
+				vm.stackTop -= 3;
+				push(value);
+				break;
+			}
 		}
 	}
 
@@ -862,4 +2256,6 @@ static InterpretResult run(void)
 #undef READ_CONSTANT
 #undef READ_STRING
 #undef BINARY_OP
+#undef INT_BINARY_OP
+#undef COMPARE_OP
 }
@@ -0,0 +1,102 @@
+#!/bin/sh
+#
+#  run_tests.sh
+#  clox
+#
+#  Builds clox once with the default settings and once per mode below, runs every test script
+#  with each build, and checks that each mode prints exactly what the default build does. The
+#  compiler modes are lazy and threads, migrate makes every growing table resize incrementally.
+#  Run it from the clox directory:
+#
+#    test/run_tests.sh [mode ...]
+#
+#  With no modes given it runs all of them. CC and CFLAGS are passed through to every build, so
+#  for example CFLAGS=-DHASH_SEED=1234 runs everything with the same hash seed every time.
+#
+
+set -u
+
+modeFlags()
+{
+	case "$1" in
+		lazy)		echo "-DCOMPILER_LAZY_FUNCTIONS=1" ;;
+		threads)	echo "-DCOMPILER_THREADS=4" ;;
+		migrate)	echo "-DTABLE_INCREMENTAL_CAPACITY=16" ;;
+		*)			return 1 ;;
+	esac
+}
+
+ALL_MODES="lazy threads migrate"
+
+CC="${CC:-cc}"
+CFLAGS="${CFLAGS:-}"
+WARNINGS="-Wall -Wextra -Wno-unused-parameter -Werror"
+
+if [ $# -eq 0 ]; then
+	set -- $ALL_MODES
+fi
+
+for mode in "$@"; do
+	if ! modeFlags "$mode" > /dev/null; then
+		echo "Unknown mode '$mode', expected one of: $ALL_MODES"
+		exit 2
+	fi
+done
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+build()
+{
+	# $1 is the executable to write, the rest are extra flags
+
+	out="$1"
+	shift
+	$CC -std=c11 $WARNINGS -O2 -DNDEBUG -Iinclude $CFLAGS "$@" src/*.c -o "$out" -lm -lpthread
+}
+
+# Prints a script's output and exit status, minus anything that's allowed to differ between builds
+
+runScript()
+{
+	"$1" "$2" > "$dir/raw.txt" 2>&1
+	status=$?
+	grep -v '^\[Memory\]' "$dir/raw.txt"
+	echo "exit $status"
+}
+
+echo "Building default"
+build "$dir/clox" || exit 1
+
+failed=0
+
+for mode in "$@"; do
+	echo "Building $mode"
+
+	if ! build "$dir/clox_$mode" $(modeFlags "$mode"); then
+		failed=1
+		continue
+	fi
+
+	for script in test/*.clox; do
+		# Prints timings, which never match
+
+		[ "$(basename "$script")" = "test_time.clox" ] && continue
+
+		runScript "$dir/clox" "$script" > "$dir/expected.txt"
+		runScript "$dir/clox_$mode" "$script" > "$dir/actual.txt"
+
+		if ! cmp -s "$dir/expected.txt" "$dir/actual.txt"; then
+			echo "FAIL $mode $script"
+			diff "$dir/expected.txt" "$dir/actual.txt" | head -20
+			failed=1
+		fi
+	done
+done
+
+if [ $failed -ne 0 ]; then
+	echo "Some tests failed"
+	exit 1
+fi
+
+echo "All tests passed"